@@ -0,0 +1,329 @@
+/*****************************************************************************
+ * Runs the benchmark workloads in `bench/` with the frankenscript
+ * interpreter and reports the timings as JSON. The results can be compared
+ * against a previous run to catch performance regressions.
+ */
+
+#include <CLI/CLI.hpp>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <optional>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef _WIN32
+#  include <fcntl.h>
+#  include <sys/resource.h>
+#  include <sys/wait.h>
+#  include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+struct RunResult
+{
+  bool success;
+  double ms;
+  /// The peak resident set size in KiB, if it's available
+  std::optional<long> peak_rss_kb;
+};
+
+struct Workload
+{
+  std::string name;
+  fs::path path;
+  /// The number of operations performed by the workload, taken from the
+  /// `# ops: <n>` line of the file.
+  uint64_t ops;
+  std::vector<RunResult> runs;
+
+  double min_ms() const
+  {
+    double result = runs.front().ms;
+    for (auto& run : runs)
+      result = std::min(result, run.ms);
+    return result;
+  }
+
+  double median_ms() const
+  {
+    std::vector<double> times;
+    for (auto& run : runs)
+      times.push_back(run.ms);
+    std::sort(times.begin(), times.end());
+    auto mid = times.size() / 2;
+    return times.size() % 2 ? times[mid] : (times[mid - 1] + times[mid]) / 2;
+  }
+
+  double mean_ms() const
+  {
+    double sum = 0;
+    for (auto& run : runs)
+      sum += run.ms;
+    return sum / runs.size();
+  }
+
+  std::optional<long> peak_rss_kb() const
+  {
+    std::optional<long> result;
+    for (auto& run : runs)
+    {
+      if (run.peak_rss_kb)
+        result = std::max(result.value_or(0), run.peak_rss_kb.value());
+    }
+    return result;
+  }
+
+  bool success() const
+  {
+    return std::all_of(
+      runs.begin(), runs.end(), [](auto& run) { return run.success; });
+  }
+};
+
+uint64_t read_ops(const fs::path& path)
+{
+  std::ifstream file(path);
+  std::string line;
+  std::string prefix = "# ops:";
+  while (std::getline(file, line))
+  {
+    if (line.starts_with(prefix))
+      return std::stoull(line.substr(prefix.size()));
+  }
+  return 0;
+}
+
+RunResult run_once(const std::string& frankenscript, const fs::path& path)
+{
+  // The workloads measure the interpreter, the console output, the diagrams
+  // and the object registry would only add noise.
+  std::vector<std::string> args{
+    frankenscript,
+    "build",
+    path.string(),
+    "--ui",
+    "none",
+    "--log-level",
+    "none",
+    "--no-object-registry"};
+
+  auto start = std::chrono::steady_clock::now();
+#ifdef _WIN32
+  std::stringstream command;
+  command << "\"";
+  for (auto& arg : args)
+    command << "\"" << arg << "\" ";
+  command << "> NUL 2>&1\"";
+  auto status = std::system(command.str().c_str());
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::milli> ms = end - start;
+  return {status == 0, ms.count(), std::nullopt};
+#else
+  auto pid = fork();
+  if (pid == 0)
+  {
+    auto null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+
+    std::vector<char*> argv;
+    for (auto& arg : args)
+      argv.push_back(arg.data());
+    argv.push_back(nullptr);
+    execv(argv[0], argv.data());
+    _exit(127);
+  }
+
+  int status = 0;
+  struct rusage usage;
+  auto waited = wait4(pid, &status, 0, &usage);
+  auto end = std::chrono::steady_clock::now();
+  std::chrono::duration<double, std::milli> ms = end - start;
+
+  if (waited != pid)
+    return {false, ms.count(), std::nullopt};
+
+#  ifdef __APPLE__
+  // macOS reports the size in bytes
+  long rss_kb = usage.ru_maxrss / 1024;
+#  else
+  long rss_kb = usage.ru_maxrss;
+#  endif
+  auto success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+  return {success, ms.count(), rss_kb};
+#endif
+}
+
+void write_json(std::ostream& out, std::vector<Workload>& workloads)
+{
+  // Each workload is written on a single line, `read_baseline` depends on it
+  out << "{" << std::endl << "  \"workloads\": [" << std::endl;
+  for (size_t i = 0; i < workloads.size(); i++)
+  {
+    auto& w = workloads[i];
+    auto median = w.median_ms();
+    auto rss = w.peak_rss_kb();
+    out << std::fixed << std::setprecision(3) << "    {\"name\": \"" << w.name
+        << "\", \"success\": " << (w.success() ? "true" : "false")
+        << ", \"ops\": " << w.ops << ", \"runs\": " << w.runs.size()
+        << ", \"min_ms\": " << w.min_ms() << ", \"median_ms\": " << median
+        << ", \"mean_ms\": " << w.mean_ms() << ", \"ops_per_sec\": "
+        << (median > 0 ? w.ops / (median / 1000) : 0) << ", \"peak_rss_kb\": "
+        << (rss ? std::to_string(rss.value()) : "null") << "}"
+        << (i + 1 < workloads.size() ? "," : "") << std::endl;
+  }
+  out << "  ]" << std::endl << "}" << std::endl;
+}
+
+/// Reads the median times of a file written by `write_json`.
+std::map<std::string, double> read_baseline(const std::string& path)
+{
+  std::map<std::string, double> result;
+  std::ifstream file(path);
+  if (!file)
+  {
+    std::cerr << "Unable to read the baseline " << path << std::endl;
+    exit(2);
+  }
+
+  std::regex entry(R"re("name": "([^"]+)".*"median_ms": ([0-9.eE+-]+))re");
+  std::string line;
+  while (std::getline(file, line))
+  {
+    std::smatch match;
+    if (std::regex_search(line, match, entry))
+      result[match[1]] = std::stod(match[2]);
+  }
+  return result;
+}
+
+/// Compares the medians with the baseline. Returns false, if a workload got
+/// slower by more than `threshold` percent.
+bool compare(
+  std::vector<Workload>& workloads,
+  std::map<std::string, double>& baseline,
+  double threshold)
+{
+  bool ok = true;
+  std::cerr << std::endl
+            << std::left << std::setw(20) << "workload" << std::right
+            << std::setw(14) << "baseline ms" << std::setw(14) << "current ms"
+            << std::setw(10) << "change" << std::endl;
+  for (auto& w : workloads)
+  {
+    auto search = baseline.find(w.name);
+    if (search == baseline.end())
+    {
+      std::cerr << std::left << std::setw(20) << w.name << "  (no baseline)"
+                << std::endl;
+      continue;
+    }
+
+    auto old_ms = search->second;
+    auto new_ms = w.median_ms();
+    auto change = old_ms > 0 ? (new_ms - old_ms) / old_ms * 100 : 0;
+    auto regressed = change > threshold;
+    ok &= !regressed;
+    std::cerr << std::left << std::setw(20) << w.name << std::right
+              << std::fixed << std::setprecision(2) << std::setw(14) << old_ms
+              << std::setw(14) << new_ms << std::setw(9) << std::showpos
+              << change << std::noshowpos << "%"
+              << (regressed ? "  REGRESSION" : "") << std::endl;
+  }
+  return ok;
+}
+
+int main(int argc, char** argv)
+{
+  std::string frankenscript = FRANKENSCRIPT_BIN;
+  std::string bench_dir = FRANKENSCRIPT_BENCH_DIR;
+  size_t runs = 5;
+  std::string filter;
+  std::string out;
+  std::string baseline;
+  double threshold = 10;
+
+  CLI::App app{"Runs the frankenscript benchmark workloads"};
+  app.add_option(
+    "--frankenscript", frankenscript, "The interpreter to benchmark");
+  app.add_option(
+    "--bench-dir", bench_dir, "The directory with the .frank workloads");
+  app.add_option("-r,--runs", runs, "The number of runs per workload");
+  app.add_option(
+    "-f,--filter", filter, "Only run workloads containing this string");
+  app.add_option(
+    "-o,--out", out, "Write the JSON results to this file, not stdout");
+  app.add_option(
+    "-b,--baseline",
+    baseline,
+    "Results of a previous run to compare against. Regressions make the "
+    "benchmark fail");
+  app.add_option(
+    "-t,--threshold",
+    threshold,
+    "The slowdown in percent, that counts as a regression");
+  CLI11_PARSE(app, argc, argv);
+
+  if (runs == 0)
+  {
+    std::cerr << "At least one run is required" << std::endl;
+    return 2;
+  }
+
+  std::vector<Workload> workloads;
+  for (auto& entry : fs::directory_iterator(bench_dir))
+  {
+    auto path = entry.path();
+    auto name = path.stem().string();
+    if (path.extension() != ".frank" || name.find(filter) == std::string::npos)
+      continue;
+    workloads.push_back({name, path, read_ops(path), {}});
+  }
+  std::sort(workloads.begin(), workloads.end(), [](auto& a, auto& b) {
+    return a.name < b.name;
+  });
+
+  bool success = true;
+  for (auto& w : workloads)
+  {
+    std::cerr << "Running " << w.name << " " << std::flush;
+    for (size_t i = 0; i < runs; i++)
+    {
+      w.runs.push_back(run_once(frankenscript, w.path));
+      std::cerr << (w.runs.back().success ? "." : "x") << std::flush;
+    }
+    std::cerr << " " << std::fixed << std::setprecision(2) << w.median_ms()
+              << " ms" << std::endl;
+    if (!w.success())
+    {
+      std::cerr << "  " << w.name << " failed" << std::endl;
+      success = false;
+    }
+  }
+
+  if (out.empty())
+  {
+    write_json(std::cout, workloads);
+  }
+  else
+  {
+    std::ofstream file(out);
+    write_json(file, workloads);
+  }
+
+  if (!baseline.empty())
+  {
+    auto base = read_baseline(baseline);
+    success &= compare(workloads, base, threshold);
+  }
+
+  return success ? 0 : 1;
+}
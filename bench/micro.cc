@@ -0,0 +1,452 @@
+/*****************************************************************************
+ * Microbenchmarks for the runtime primitives. They call the `rt` functions
+ * directly on synthetic heaps, which keeps the parser, interpreter and UI out
+ * of the measurements.
+ */
+
+#include "../src/rt/objects/dyn_object.h"
+#include "../src/rt/rt.h"
+
+#include <CLI/CLI.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+using rt::objects::DynObject;
+using rt::objects::Region;
+
+enum class Shape
+{
+  /// Every node points to the next one
+  Chain,
+  /// A binary tree
+  Tree,
+  /// Every node points to the next two nodes, most nodes are shared
+  Dag,
+  /// A chain, where the last node points back to the first one
+  Cycle,
+};
+
+static const char* shape_name(Shape shape)
+{
+  switch (shape)
+  {
+    case Shape::Chain:
+      return "chain";
+    case Shape::Tree:
+      return "tree";
+    case Shape::Dag:
+      return "dag";
+    case Shape::Cycle:
+      return "cycle";
+  }
+  return "unknown";
+}
+
+/// The object, that holds all references of the benchmark, like the frame of
+/// the interpreter.
+static DynObject* local()
+{
+  static DynObject* local = rt::make_object();
+  return local;
+}
+
+/// Stores `target` in the field `key` of `src` and adds the reference.
+static void link(DynObject* src, rt::Atom key, DynObject* target)
+{
+  auto old = rt::set(src, key, target);
+  rt::add_reference(src, target);
+  rt::remove_reference(src, old);
+}
+
+static void unlink(DynObject* src, rt::Atom key)
+{
+  auto old = rt::set(src, key, nullptr);
+  rt::remove_reference(src, old);
+}
+
+/// A graph of `n` objects in the local region. Only the root is referenced by
+/// `local()`.
+struct Graph
+{
+  Shape shape;
+  std::vector<DynObject*> nodes;
+
+  Graph(Shape shape_, size_t n) : shape(shape_)
+  {
+    static auto a = rt::intern("a");
+    static auto b = rt::intern("b");
+
+    for (size_t i = 0; i < std::max<size_t>(n, 1); i++)
+    {
+      nodes.push_back(rt::make_object());
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+      auto edge = [&](rt::Atom key, size_t target) {
+        if (target < nodes.size())
+          link(nodes[i], key, nodes[target]);
+      };
+      switch (shape)
+      {
+        case Shape::Chain:
+          edge(a, i + 1);
+          break;
+        case Shape::Tree:
+          edge(a, 2 * i + 1);
+          edge(b, 2 * i + 2);
+          break;
+        case Shape::Dag:
+          edge(a, i + 1);
+          edge(b, i + 2);
+          break;
+        case Shape::Cycle:
+          edge(a, (i + 1) % nodes.size());
+          break;
+      }
+    }
+
+    for (size_t i = 1; i < nodes.size(); i++)
+    {
+      rt::remove_reference(local(), nodes[i]);
+    }
+  }
+
+  DynObject* root()
+  {
+    return nodes[0];
+  }
+
+  /// Drops the graph. Cycles in the local region are not collected, the
+  /// back edge is therefore removed first.
+  void drop()
+  {
+    static auto a = rt::intern("a");
+    if (shape == Shape::Cycle && !root()->is_immutable())
+    {
+      unlink(nodes.back(), a);
+    }
+    rt::remove_reference(local(), root());
+    nodes.clear();
+  }
+};
+
+/// Creates a region that contains a graph of `n` objects.
+static DynObject* region_with(Shape shape, size_t n)
+{
+  static auto root = rt::intern("root");
+  auto bridge = rt::create_region();
+  Graph graph(shape, n);
+  link(bridge, root, graph.root());
+  rt::remove_reference(local(), graph.root());
+  return bridge;
+}
+
+/// Measures a single run of a benchmark. The timer is started and stopped by
+/// the benchmark, to exclude building and dropping the heap.
+class Timer
+{
+  using Clock = std::chrono::steady_clock;
+  Clock::time_point begin;
+  double ns{0};
+
+public:
+  void start()
+  {
+    begin = Clock::now();
+  }
+
+  void stop()
+  {
+    ns += std::chrono::duration<double, std::nano>(Clock::now() - begin)
+            .count();
+  }
+
+  double elapsed_ns()
+  {
+    return ns;
+  }
+};
+
+struct Benchmark
+{
+  std::string name;
+  /// The number of operations of a run, the results are reported per
+  /// operation.
+  size_t ops;
+  std::function<void(Timer&)> run;
+};
+
+struct Stats
+{
+  double min;
+  double median;
+  double mean;
+  double stddev;
+};
+
+static Stats summarize(std::vector<double> samples)
+{
+  std::sort(samples.begin(), samples.end());
+  auto n = samples.size();
+  auto mid = n / 2;
+  Stats stats{};
+  stats.min = samples.front();
+  stats.median = n % 2 ? samples[mid] : (samples[mid - 1] + samples[mid]) / 2;
+  for (auto s : samples)
+    stats.mean += s;
+  stats.mean /= n;
+  for (auto s : samples)
+    stats.stddev += (s - stats.mean) * (s - stats.mean);
+  stats.stddev = n > 1 ? std::sqrt(stats.stddev / (n - 1)) : 0;
+  return stats;
+}
+
+static std::vector<Benchmark> benchmarks(size_t n)
+{
+  std::vector<Benchmark> result;
+  auto shapes = {Shape::Chain, Shape::Tree, Shape::Dag, Shape::Cycle};
+
+  // Local references only change the RC
+  result.push_back({"add_remove_reference/local", n, [n](Timer& timer) {
+                      auto a = rt::make_object();
+                      auto b = rt::make_object();
+                      timer.start();
+                      for (size_t i = 0; i < n; i++)
+                      {
+                        rt::add_reference(a, b);
+                        rt::remove_reference(a, b);
+                      }
+                      timer.stop();
+                      rt::remove_reference(local(), a);
+                      rt::remove_reference(local(), b);
+                    }});
+
+  // The reference to the innermost of `n` nested regions opens and closes
+  // all of them, the SBRC is updated up to the outermost region.
+  result.push_back(
+    {"add_remove_reference/region_nest", n, [n](Timer& timer) {
+       static auto child = rt::intern("child");
+       auto outer = rt::create_region();
+       auto inner = outer;
+       for (size_t i = 1; i < n; i++)
+       {
+         auto next = rt::create_region();
+         link(inner, child, next);
+         rt::remove_reference(local(), next);
+         inner = next;
+       }
+       timer.start();
+       for (size_t i = 0; i < n; i++)
+       {
+         rt::add_reference(local(), inner);
+         rt::remove_reference(local(), inner);
+       }
+       timer.stop();
+       rt::remove_reference(local(), outer);
+       Region::collect();
+     }});
+
+  // Moving a reference into a region decrements its LRC, moving it back out
+  // increments it again.
+  result.push_back({"move_reference/region", n, [n](Timer& timer) {
+                      static auto root = rt::intern("root");
+                      auto bridge = region_with(Shape::Chain, 1);
+                      auto target = rt::get(bridge, root).value();
+                      rt::add_reference(local(), target);
+                      timer.start();
+                      for (size_t i = 0; i < n; i++)
+                      {
+                        rt::move_reference(local(), bridge, target);
+                        rt::move_reference(bridge, local(), target);
+                      }
+                      timer.stop();
+                      rt::remove_reference(local(), target);
+                      rt::remove_reference(local(), bridge);
+                      Region::collect();
+                    }});
+
+  // Looks up a key, that is defined at the end of a prototype chain of `n`
+  // objects.
+  result.push_back({"get/prototype_chain", n, [n](Timer& timer) {
+                      static auto key = rt::intern("key");
+                      auto obj = rt::make_object();
+                      auto value = rt::make_object();
+                      link(obj, key, value);
+                      rt::remove_reference(local(), value);
+                      for (size_t i = 1; i < n; i++)
+                      {
+                        auto next = rt::make_object();
+                        auto old = rt::set_prototype(next, obj);
+                        rt::remove_reference(next, old);
+                        rt::move_reference(local(), next, obj);
+                        obj = next;
+                      }
+                      size_t found = 0;
+                      timer.start();
+                      for (size_t i = 0; i < n; i++)
+                      {
+                        found += rt::get(obj, key).has_value();
+                      }
+                      timer.stop();
+                      if (found != n)
+                        std::cerr << "The key was not found" << std::endl;
+                      rt::remove_reference(local(), obj);
+                    }});
+
+  for (auto shape : shapes)
+  {
+    result.push_back(
+      {std::string("visit/") + shape_name(shape), n, [n, shape](Timer& timer) {
+         Graph graph(shape, n);
+         std::unordered_set<DynObject*> seen;
+         seen.reserve(n * 2);
+         timer.start();
+         rt::objects::visit(graph.root(), [&](rt::objects::Edge e) {
+           return e.target && seen.insert(e.target).second;
+         });
+         timer.stop();
+         graph.drop();
+       }});
+  }
+
+  for (auto shape : shapes)
+  {
+    result.push_back(
+      {std::string("freeze/") + shape_name(shape), n, [n, shape](Timer& timer) {
+         Graph graph(shape, n);
+         timer.start();
+         rt::freeze(graph.root());
+         timer.stop();
+         graph.drop();
+       }});
+  }
+
+  // `n` dirty regions, which are referenced by the fields of a local object.
+  // The LRCs are recomputed from the fields, the regions therefore can't
+  // only be referenced by `local()`.
+  result.push_back({"clean_lrcs/regions", n, [n](Timer& timer) {
+                      auto holder = rt::make_object();
+                      for (size_t i = 0; i < n; i++)
+                      {
+                        auto bridge = region_with(Shape::Chain, 1);
+                        link(holder, rt::intern(std::to_string(i)), bridge);
+                        rt::remove_reference(local(), bridge);
+                        rt::objects::get_region(bridge)->mark_dirty();
+                      }
+                      timer.start();
+                      Region::clean_lrcs();
+                      timer.stop();
+                      rt::remove_reference(local(), holder);
+                      Region::collect();
+                    }});
+
+  // Drops a region with `n` objects
+  result.push_back({"region_teardown", n, [n](Timer& timer) {
+                      auto bridge = region_with(Shape::Tree, n);
+                      timer.start();
+                      rt::remove_reference(local(), bridge);
+                      Region::collect();
+                      timer.stop();
+                    }});
+
+  // Merges a region with `n` objects into its parent region
+  result.push_back({"merge_regions", n, [n](Timer& timer) {
+                      static auto child = rt::intern("child");
+                      auto sink = region_with(Shape::Chain, n);
+                      auto src = region_with(Shape::Chain, n);
+                      link(sink, child, src);
+                      rt::remove_reference(local(), src);
+                      timer.start();
+                      rt::merge_regions(src, sink);
+                      timer.stop();
+                      rt::remove_reference(local(), sink);
+                      Region::collect();
+                    }});
+
+  return result;
+}
+
+int main(int argc, char** argv)
+{
+  size_t size = 1000;
+  size_t warmup = 3;
+  size_t reps = 10;
+  std::string filter;
+  std::string out;
+
+  CLI::App app{"Runs the microbenchmarks of the frankenscript runtime"};
+  app.add_option(
+    "-n,--size", size, "The number of objects or operations per run");
+  app.add_option("-w,--warmup", warmup, "The runs before measuring");
+  app.add_option("-r,--reps", reps, "The number of measured runs");
+  app.add_option(
+    "-f,--filter", filter, "Only run benchmarks containing this string");
+  app.add_option("-o,--out", out, "Write the results as JSON to this file");
+  CLI11_PARSE(app, argc, argv);
+
+  if (reps == 0 || size == 0)
+  {
+    std::cerr << "The size and the number of runs have to be positive"
+              << std::endl;
+    return 2;
+  }
+
+  rt::ui::select_ui("none");
+  rt::log::set_level(rt::log::Level::None);
+
+  std::stringstream json;
+  json << "{" << std::endl << "  \"benchmarks\": [";
+  bool first = true;
+
+  std::cout << std::left << std::setw(32) << "benchmark (ns/op)" << std::right
+            << std::setw(12) << "min" << std::setw(12) << "median"
+            << std::setw(12) << "mean" << std::setw(12) << "stddev"
+            << std::endl;
+  for (auto& bench : benchmarks(size))
+  {
+    if (bench.name.find(filter) == std::string::npos)
+      continue;
+
+    std::vector<double> samples;
+    for (size_t i = 0; i < warmup + reps; i++)
+    {
+      Timer timer;
+      bench.run(timer);
+      if (i >= warmup)
+        samples.push_back(timer.elapsed_ns() / bench.ops);
+    }
+
+    auto stats = summarize(samples);
+    std::cout << std::left << std::setw(32) << bench.name << std::right
+              << std::fixed << std::setprecision(1) << std::setw(12)
+              << stats.min << std::setw(12) << stats.median << std::setw(12)
+              << stats.mean << std::setw(12) << stats.stddev << std::endl;
+
+    json << (first ? "" : ",") << std::endl
+         << std::fixed << std::setprecision(3) << "    {\"name\": \""
+         << bench.name << "\", \"size\": " << size << ", \"reps\": " << reps
+         << ", \"min_ns\": " << stats.min << ", \"median_ns\": "
+         << stats.median << ", \"mean_ns\": " << stats.mean
+         << ", \"stddev_ns\": " << stats.stddev << "}";
+    first = false;
+  }
+  json << std::endl << "  ]" << std::endl << "}" << std::endl;
+
+  if (!out.empty())
+  {
+    std::ofstream file(out);
+    file << json.str();
+  }
+
+  return 0;
+}
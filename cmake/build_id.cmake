@@ -0,0 +1,27 @@
+# Computes the build ID of frankenscript and writes it as a header to OUTPUT.
+# The ID is a hash of all sources below SOURCE_DIR/src and of CMakeLists.txt,
+# which pins the version of trieste. It identifies the compiler that created
+# a bytecode cache, any change to a pass, the lowering or the runtime
+# therefore invalidates existing caches.
+#
+# Usage: cmake -DSOURCE_DIR=<dir> -DOUTPUT=<file> -P build_id.cmake
+
+file(GLOB_RECURSE SOURCES RELATIVE ${SOURCE_DIR}
+  ${SOURCE_DIR}/src/*.h
+  ${SOURCE_DIR}/src/*.cc
+)
+list(SORT SOURCES)
+list(APPEND SOURCES CMakeLists.txt)
+
+set(HASHES "")
+foreach(SOURCE ${SOURCES})
+  file(SHA256 ${SOURCE_DIR}/${SOURCE} HASH)
+  string(APPEND HASHES "${SOURCE} ${HASH}\n")
+endforeach()
+string(SHA256 BUILD_ID "${HASHES}")
+string(SUBSTRING ${BUILD_ID} 0 16 BUILD_ID)
+
+file(WRITE ${OUTPUT}
+  "#pragma once\n\n"
+  "// Generated by cmake/build_id.cmake\n"
+  "#define FRANKENSCRIPT_BUILD_ID 0x${BUILD_ID}ull\n")
@@ -0,0 +1,485 @@
+#include "cache.h"
+
+#include "../rt/rt.h"
+#include "build_id.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string_view>
+
+#ifdef _WIN32
+#  ifndef NOMINMAX
+#    define NOMINMAX
+#  endif
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif
+#  include <windows.h>
+#else
+#  include <fcntl.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <unistd.h>
+#endif
+
+namespace verona::interpreter
+{
+  constexpr char CacheMagic[8] = {'F', 'R', 'A', 'N', 'K', 'C', '\0', '\0'};
+
+  constexpr uint64_t hash(uint64_t result, std::string_view data)
+  {
+    // FNV-1a
+    for (auto c : data)
+    {
+      result ^= static_cast<uint8_t>(c);
+      result *= 0x100000001b3;
+    }
+    return result;
+  }
+
+  constexpr uint64_t hash(std::string_view data)
+  {
+    return hash(0xcbf29ce484222325, data);
+  }
+
+  /// Identifies the compiler that created a cache. The build ID is a hash
+  /// of all sources, see `cmake/build_id.cmake`. Any change to the passes,
+  /// the lowering or the cache format therefore invalidates existing caches.
+  constexpr uint64_t compiler_version()
+  {
+    return hash(std::string_view(CacheMagic, 8)) ^ FRANKENSCRIPT_BUILD_ID;
+  }
+
+  /// Returns true, if the `arg` of `op` is an `rt::Atom`. Atoms are only
+  /// valid in the current process, these are stored by name.
+  static bool has_atom_arg(Opcode op)
+  {
+    switch (op)
+    {
+      case Opcode::LoadFrame:
+      case Opcode::StoreFrame:
+      case Opcode::SwapFrame:
+      case Opcode::MoveFrame:
+      case Opcode::StoreFieldConst:
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  static std::optional<uint64_t> source_hash(const std::string& source_path)
+  {
+    std::ifstream file(source_path, std::ios::binary);
+    if (!file)
+    {
+      return std::nullopt;
+    }
+    std::stringstream content;
+    content << file.rdbuf();
+    return hash(content.str());
+  }
+
+  /// A read-only memory mapping of an entire file.
+  class MappedFile
+  {
+    const char* data{nullptr};
+    size_t size{0};
+#ifdef _WIN32
+    HANDLE mapping{nullptr};
+#endif
+
+  public:
+    MappedFile(const std::string& path)
+    {
+#ifdef _WIN32
+      auto file = CreateFileA(
+        path.c_str(),
+        GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_DELETE,
+        nullptr,
+        OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL,
+        nullptr);
+      if (file == INVALID_HANDLE_VALUE)
+      {
+        return;
+      }
+
+      LARGE_INTEGER file_size;
+      if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+      {
+        mapping =
+          CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping)
+        {
+          data = static_cast<const char*>(
+            MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+          size = data ? static_cast<size_t>(file_size.QuadPart) : 0;
+        }
+      }
+      CloseHandle(file);
+#else
+      auto fd = open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+      {
+        return;
+      }
+
+      struct stat info;
+      if (fstat(fd, &info) == 0 && info.st_size > 0)
+      {
+        auto mem = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mem != MAP_FAILED)
+        {
+          data = static_cast<const char*>(mem);
+          size = info.st_size;
+        }
+      }
+      close(fd);
+#endif
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile()
+    {
+#ifdef _WIN32
+      if (data)
+      {
+        UnmapViewOfFile(data);
+      }
+      if (mapping)
+      {
+        CloseHandle(mapping);
+      }
+#else
+      if (data)
+      {
+        munmap(const_cast<char*>(data), size);
+      }
+#endif
+    }
+
+    std::string_view content()
+    {
+      return {data, size};
+    }
+  };
+
+  /// Serializes the bytecode into the cache format. Values are stored in
+  /// the native byte order, caches are not meant to be shared between
+  /// machines.
+  class CacheWriter
+  {
+    std::string out;
+
+    template<typename T>
+    void value(T v)
+    {
+      out.append(reinterpret_cast<const char*>(&v), sizeof(T));
+    }
+
+    void string(std::string_view value)
+    {
+      this->value(static_cast<uint32_t>(value.size()));
+      out.append(value);
+    }
+
+    template<typename T, typename F>
+    void list(const std::vector<T>& items, F write)
+    {
+      value(static_cast<uint32_t>(items.size()));
+      for (auto& item : items)
+      {
+        write(item);
+      }
+    }
+
+    void body(Bytecode* body)
+    {
+      // Atom arguments are replaced by an index into this table
+      std::vector<std::string> atoms;
+      std::map<uint32_t, uint32_t> atom_ids;
+      for (auto& instr : body->code)
+      {
+        if (has_atom_arg(instr.op) && !atom_ids.contains(instr.arg))
+        {
+          atom_ids[instr.arg] = static_cast<uint32_t>(atoms.size());
+          atoms.emplace_back(rt::atom_name(rt::Atom{instr.arg}));
+        }
+      }
+
+      list(body->names, [&](auto& name) { string(name); });
+      list(atoms, [&](auto& name) { string(name); });
+      list(body->strings, [&](auto obj) { string(rt::get_key(obj)); });
+      list(body->global_caches, [&](auto& cache) {
+        string(rt::atom_name(cache.name));
+      });
+      value(static_cast<uint32_t>(body->field_caches.size()));
+      list(body->code, [&](auto& instr) {
+        value(static_cast<uint8_t>(instr.op));
+        value(has_atom_arg(instr.op) ? atom_ids[instr.arg] : instr.arg);
+      });
+      list(body->lines, [&](auto line) { value(line); });
+      list(body->funcs, [&](auto& func) { this->body(func.get()); });
+    }
+
+  public:
+    std::string write(uint64_t source, Bytecode* main_body)
+    {
+      out.append(CacheMagic, sizeof(CacheMagic));
+      value(compiler_version());
+      value(source);
+      body(main_body);
+      return std::move(out);
+    }
+  };
+
+  /// Reads the cache format. Every read is checked against the end of the
+  /// data, broken caches are rejected instead of crashing the interpreter.
+  class CacheReader
+  {
+    std::string_view data;
+    bool failed{false};
+
+    template<typename T>
+    T value()
+    {
+      T result{};
+      if (data.size() < sizeof(T))
+      {
+        failed = true;
+        return result;
+      }
+      std::memcpy(&result, data.data(), sizeof(T));
+      data.remove_prefix(sizeof(T));
+      return result;
+    }
+
+    std::string_view string()
+    {
+      auto size = value<uint32_t>();
+      if (data.size() < size)
+      {
+        failed = true;
+        return {};
+      }
+      auto result = data.substr(0, size);
+      data.remove_prefix(size);
+      return result;
+    }
+
+    /// Reads the size of a list, with at least `min_item_size` bytes per
+    /// item.
+    uint32_t count(size_t min_item_size)
+    {
+      auto result = value<uint32_t>();
+      if (data.size() / min_item_size < result)
+      {
+        failed = true;
+        return 0;
+      }
+      return result;
+    }
+
+    bool check_arg(Bytecode* body, Instr instr, size_t atom_count)
+    {
+      if (has_atom_arg(instr.op))
+        return instr.arg < atom_count;
+
+      switch (instr.op)
+      {
+        case Opcode::LoadGlobal:
+          return instr.arg < body->global_caches.size();
+        case Opcode::LoadField:
+        case Opcode::LoadFieldConst:
+          return instr.arg < body->field_caches.size();
+        case Opcode::CreateString:
+          return instr.arg < body->strings.size();
+        case Opcode::Print:
+          return instr.arg < body->names.size();
+        case Opcode::Jump:
+        case Opcode::JumpFalse:
+          return instr.arg < body->code.size();
+        case Opcode::CreateFunc:
+          return instr.arg < body->funcs.size();
+        default:
+          return true;
+      }
+    }
+
+    std::unique_ptr<Bytecode> body()
+    {
+      auto result = std::make_unique<Bytecode>();
+
+      auto names = count(sizeof(uint32_t));
+      for (uint32_t i = 0; i < names && !failed; i++)
+      {
+        result->names.emplace_back(string());
+      }
+
+      std::vector<rt::Atom> atoms;
+      auto atom_count = count(sizeof(uint32_t));
+      for (uint32_t i = 0; i < atom_count && !failed; i++)
+      {
+        atoms.push_back(rt::intern(string()));
+      }
+
+      auto strings = count(sizeof(uint32_t));
+      for (uint32_t i = 0; i < strings && !failed; i++)
+      {
+        result->strings.push_back(rt::get_str_constant(string()));
+      }
+
+      auto globals = count(sizeof(uint32_t));
+      for (uint32_t i = 0; i < globals && !failed; i++)
+      {
+        result->global_caches.push_back({rt::intern(string())});
+      }
+
+      // Checked against the code size below, every cache belongs to an
+      // instruction
+      auto fields = value<uint32_t>();
+
+      auto code = count(sizeof(uint8_t) + sizeof(uint32_t));
+      result->code.reserve(code);
+      for (uint32_t i = 0; i < code && !failed; i++)
+      {
+        auto op = value<uint8_t>();
+        auto arg = value<uint32_t>();
+        if (op >= OpcodeCount)
+        {
+          failed = true;
+        }
+        result->code.push_back({static_cast<Opcode>(op), arg});
+      }
+      if (fields > result->code.size())
+      {
+        failed = true;
+      }
+      result->field_caches.resize(failed ? 0 : fields);
+
+      auto lines = count(sizeof(uint32_t));
+      if (lines != 0 && lines != result->code.size())
+      {
+        failed = true;
+      }
+      for (uint32_t i = 0; i < lines && !failed; i++)
+      {
+        result->lines.push_back(value<uint32_t>());
+      }
+
+      auto funcs = count(sizeof(uint32_t));
+      for (uint32_t i = 0; i < funcs && !failed; i++)
+      {
+        result->funcs.push_back(body());
+      }
+
+      // Bodies always end with a `Return`, see `lower`
+      if (
+        failed || result->code.empty() ||
+        result->code.back().op != Opcode::Return)
+      {
+        failed = true;
+        return nullptr;
+      }
+
+      for (auto& instr : result->code)
+      {
+        if (!check_arg(result.get(), instr, atoms.size()))
+        {
+          failed = true;
+          return nullptr;
+        }
+        if (has_atom_arg(instr.op))
+        {
+          instr.arg = static_cast<uint32_t>(atoms[instr.arg]);
+        }
+      }
+
+      return result;
+    }
+
+  public:
+    CacheReader(std::string_view data_) : data(data_) {}
+
+    std::unique_ptr<Bytecode> read(uint64_t source)
+    {
+      if (!data.starts_with(std::string_view(CacheMagic, sizeof(CacheMagic))))
+      {
+        return nullptr;
+      }
+      data.remove_prefix(sizeof(CacheMagic));
+
+      if (value<uint64_t>() != compiler_version() || value<uint64_t>() != source)
+      {
+        return nullptr;
+      }
+
+      auto result = body();
+      if (failed || !data.empty())
+      {
+        return nullptr;
+      }
+      return result;
+    }
+  };
+
+  std::string cache_path(const std::string& source_path)
+  {
+    if (source_path.ends_with(".frank"))
+    {
+      return source_path + "c";
+    }
+    return source_path + ".frankc";
+  }
+
+  std::unique_ptr<Bytecode> load_cache(const std::string& source_path)
+  {
+    auto source = source_hash(source_path);
+    if (!source)
+    {
+      return nullptr;
+    }
+
+    MappedFile file(cache_path(source_path));
+    return CacheReader(file.content()).read(source.value());
+  }
+
+  void store_cache(const std::string& source_path, Bytecode* body)
+  {
+    auto source = source_hash(source_path);
+    if (!source)
+    {
+      return;
+    }
+    auto content = CacheWriter().write(source.value(), body);
+
+    // The cache is written to a temporary file first. Processes running the
+    // same program concurrently therefore never see a partial cache.
+    auto path = cache_path(source_path);
+    std::stringstream tmp_path;
+    tmp_path << path << ".tmp" << std::random_device()();
+    {
+      std::ofstream tmp(tmp_path.str(), std::ios::binary | std::ios::trunc);
+      if (!tmp || !tmp.write(content.data(), content.size()))
+      {
+        std::error_code ec;
+        std::filesystem::remove(tmp_path.str(), ec);
+        return;
+      }
+    }
+
+    std::error_code ec;
+    std::filesystem::rename(tmp_path.str(), path, ec);
+    if (ec)
+    {
+      std::filesystem::remove(tmp_path.str(), ec);
+    }
+  }
+} // namespace verona::interpreter
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "instr.h"
+
+#include <memory>
+#include <string>
+
+namespace verona::interpreter
+{
+  /// The path of the bytecode cache of the source file at `source_path`.
+  std::string cache_path(const std::string& source_path);
+
+  /// Loads the lowered bytecode of `source_path` from its cache file. Returns
+  /// `nullptr` if there is no cache or if it was created from a different
+  /// source or by a different version of the compiler.
+  std::unique_ptr<Bytecode> load_cache(const std::string& source_path);
+
+  /// Writes the lowered, not yet optimized, bytecode of `source_path` to its
+  /// cache file. Failing to write the cache is not an error.
+  void store_cache(const std::string& source_path, Bytecode* body);
+} // namespace verona::interpreter
@@ -0,0 +1,136 @@
+#pragma once
+
+#include "../rt/inline_cache.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace verona::interpreter
+{
+  /// The opcodes of the lowered bytecode, together with the name of the
+  /// bytecode token they are lowered from (See `bytecode.h`). `CreateObject`
+  /// is split up by the kind of object it creates, to avoid inspecting the
+  /// payload at runtime.
+  ///
+  /// The opcodes at the end of the list are superinstructions. They don't
+  /// have a bytecode token and are only introduced by `optimize`.
+  ///
+  /// This list is used to generate the `Opcode` enum and the dispatch table
+  /// of the interpreter, which therefore always agree on the order.
+#define FRANKENSCRIPT_OPCODES(X) \
+  X(LoadFrame, "load_frame") \
+  X(LoadGlobal, "load_global") \
+  X(StoreFrame, "store_frame") \
+  X(SwapFrame, "swap_frame") \
+  X(LoadField, "load_field") \
+  X(StoreField, "store_field") \
+  X(SwapField, "swap_field") \
+  X(CreateDictionary, "create_object") \
+  X(CreateString, "create_object") \
+  X(CreateKeyIter, "create_object") \
+  X(CreateFunc, "create_object") \
+  X(Null, "null") \
+  X(Eq, "==") \
+  X(Neq, "!=") \
+  X(Jump, "jump") \
+  X(JumpFalse, "jump_false") \
+  X(IterNext, "iter_next") \
+  X(Print, "print") \
+  X(Call, "call") \
+  X(Return, "return") \
+  X(ReturnValue, "return_value") \
+  X(ClearStack, "clear_stack") \
+  X(Dup, "dup") \
+  X(LoadFieldConst, "load_field_const") \
+  X(StoreFieldConst, "store_field_const") \
+  X(MoveFrame, "move_frame") \
+  X(TailCall, "tail_call") \
+  X(TailCallDiscard, "tail_call_discard")
+
+  enum class Opcode : uint8_t
+  {
+#define X(op, name) op,
+    FRANKENSCRIPT_OPCODES(X)
+#undef X
+  };
+
+  constexpr size_t OpcodeCount{
+#define X(op, name) 1 +
+    FRANKENSCRIPT_OPCODES(X)
+#undef X
+      0};
+
+  /// The name of the bytecode token this opcode was lowered from. This is
+  /// used for the console output of the interpreter.
+  inline const char* opcode_name(Opcode op)
+  {
+    switch (op)
+    {
+#define X(op, name) \
+  case Opcode::op: \
+    return name;
+      FRANKENSCRIPT_OPCODES(X)
+#undef X
+      default:
+        return "unknown";
+    }
+  }
+
+  /// A single pre-decoded instruction.
+  ///
+  /// The meaning of `arg` depends on the opcode:
+  /// * `LoadFrame`, `StoreFrame`, `SwapFrame` and `MoveFrame`: The
+  ///   `rt::Atom` of the name. Names are interned when the code is lowered.
+  /// * `StoreFieldConst`: The `rt::Atom` of the field name
+  /// * `LoadGlobal`: An index into `Bytecode::global_caches`, which also holds
+  ///   the name
+  /// * `LoadField` and `LoadFieldConst`: An index into
+  ///   `Bytecode::field_caches`. For `LoadFieldConst` the cache also holds
+  ///   the field name.
+  /// * `CreateString`: An index into `Bytecode::strings`
+  /// * `Print`: An index into `Bytecode::names`
+  /// * `Jump` and `JumpFalse`: The index of the instruction to continue at.
+  ///   Labels are resolved during lowering and don't appear in the code.
+  /// * `CreateFunc`: An index into `Bytecode::funcs`
+  /// * `Call`, `TailCall` and `TailCallDiscard`: The number of arguments
+  /// * `Dup`: The index from the end of the stack to duplicate
+  struct Instr
+  {
+    Opcode op;
+    uint32_t arg = 0;
+  };
+
+  /// A function body lowered into a flat array of instructions.
+  ///
+  /// The code of every body ends with a `Return` instruction, this allows the
+  /// interpreter to run without checking for the end of the code.
+  ///
+  /// Function bodies nested in this body are owned by it. The lowered code
+  /// stays alive for the entire execution, function objects only borrow it.
+  struct Bytecode
+  {
+    std::vector<Instr> code;
+    /// The source line of each instruction in `code`, or 0 if unknown.
+    std::vector<uint32_t> lines;
+    /// Names referenced by the instructions.
+    std::vector<std::string> names;
+    /// The string objects of string literals. They are created during
+    /// lowering, `CreateString` only pushes the existing object.
+    std::vector<rt::objects::DynObject*> strings;
+    /// Function bodies created by `CreateFunc` instructions.
+    std::vector<std::unique_ptr<Bytecode>> funcs;
+    /// The inline caches of `LoadField` and `LoadFieldConst` instructions.
+    std::vector<rt::FieldCache> field_caches;
+    /// The inline caches of `LoadGlobal` instructions.
+    std::vector<rt::GlobalCache> global_caches;
+  };
+
+  /// Runs peephole optimizations on the lowered code of `body` and all
+  /// nested function bodies. Common instruction sequences are fused into
+  /// superinstructions. `Print` instructions are removed, unless
+  /// `keep_print` is set.
+  void optimize(Bytecode* body, bool keep_print);
+} // namespace verona::interpreter
@@ -1,66 +1,48 @@
+#include "../rt/log.h"
 #include "../rt/rt.h"
-#include "bytecode.h"
-#include "trieste/trieste.h"
+#include "instr.h"
+#include "profiler.h"
 
 #include <iostream>
 #include <optional>
-#include <variant>
+#include <sstream>
 #include <vector>
 
+// Computed gotos are a GCC/Clang extension. Other compilers always use the
+// portable switch based dispatch.
+#if defined(FRANKENSCRIPT_THREADED_DISPATCH) && defined(__GNUC__)
+#  define USE_THREADED_DISPATCH
+#endif
+
 namespace verona::interpreter
 {
-
-  // ==============================================
-  // Public UI
-  // ==============================================
-  struct Bytecode
-  {
-    trieste::Node body;
-  };
-
-  void delete_bytecode(Bytecode* bytecode)
-  {
-    delete bytecode;
-  }
-
-  // ==============================================
-  // Statement Effects
-  // ==============================================
-  struct ExecNext
-  {};
-
-  struct ExecJump
-  {
-    trieste::Location target;
-  };
-
-  struct ExecFunc
-  {
-    trieste::Node body;
-    size_t arg_ctn;
-  };
-
-  struct ExecReturn
-  {
-    std::optional<rt::objects::DynObject*> value;
-  };
-
   // ==============================================
   // Interpreter/state
   // ==============================================
   struct InterpreterFrame
   {
-    trieste::NodeIt ip;
-    trieste::Node body;
+    /// The index of the next instruction in `body->code`
+    size_t ip;
+    Bytecode* body;
     FrameObj* frame;
+    /// Set if a tail call replaced a call whose result is discarded. Values
+    /// returned from this frame are released instead.
+    bool discard_result{false};
+    /// Set if a tail call replaced a call whose result is returned. Returning
+    /// without a value from this frame is an error.
+    bool require_result{false};
   };
 
   class Interpreter
   {
     rt::ui::UI* ui;
+    /// The profiler of this run, if profiling is enabled
+    Profiler* profiler;
     std::vector<InterpreterFrame*> frame_stack;
+    /// Popped frames, which are reused by the following calls.
+    std::vector<InterpreterFrame*> free_frames;
 
-    InterpreterFrame* push_stack_frame(trieste::Node body)
+    InterpreterFrame* push_stack_frame(Bytecode* body)
     {
       FrameObj* parent_obj = nullptr;
       if (!frame_stack.empty())
@@ -68,8 +50,17 @@ namespace verona::interpreter
         parent_obj = frame_stack.back()->frame;
       }
 
-      auto frame =
-        new InterpreterFrame{body->begin(), body, rt::make_frame(parent_obj)};
+      InterpreterFrame* frame;
+      if (free_frames.empty())
+      {
+        frame = new InterpreterFrame{};
+      }
+      else
+      {
+        frame = free_frames.back();
+        free_frames.pop_back();
+      }
+      *frame = {0, body, rt::make_frame(parent_obj)};
       frame_stack.push_back(frame);
       return frame;
     }
@@ -79,7 +70,7 @@ namespace verona::interpreter
       auto frame = frame_stack.back();
       frame_stack.pop_back();
       rt::remove_reference(frame->frame->object(), frame->frame->object());
-      delete frame;
+      free_frames.push_back(frame);
 
       if (frame_stack.empty())
       {
@@ -106,450 +97,653 @@ namespace verona::interpreter
       return frame_stack.front()->frame;
     }
 
-    std::variant<ExecNext, ExecJump, ExecFunc, ExecReturn>
-    run_stmt(trieste::Node& node)
+    /// Creates the frame for a call to a bytecode function and moves the
+    /// arguments from the stack of the calling frame to the new frame.
+    InterpreterFrame* call_frame(Bytecode* body, size_t arg_ctn)
     {
-      // ==========================================
-      // Operators that shouldn't be printed
-      // ==========================================
-      if (node == Print)
+      auto frame = push_stack_frame(body);
+      auto parent_frame = parent_stack_frame();
+
+      // Setup the new frame
+      for (size_t i = 0; i < arg_ctn; i++)
       {
-        // Console output
-        std::cout << node->location().view() << std::endl << std::endl;
+        auto value = parent_frame->frame->stack_pop("argument");
+        frame->frame->stack_push(value, "argument", false);
+        rt::move_reference(
+          parent_frame->frame->object(), frame->frame->object(), value);
+      }
 
-        // Mermaid output
-        std::vector<rt::objects::DynObject*> roots{frame()->object()};
-        ui->output(roots, std::string(node->location().view()));
+      return frame;
+    }
 
-        // Continue
-        return ExecNext{};
-      }
-      if (node == Label)
+    /// Replaces the current frame with a frame for `body`, for a call in tail
+    /// position. The arguments are moved to the new frame and the locals of
+    /// the old frame are released before the call. The frame stack therefore
+    /// doesn't grow with the depth of tail recursion.
+    ///
+    /// This is observable: the `__parent__` of the new frame is the parent of
+    /// the replaced frame, and regions only referenced by the released
+    /// locals are collected, or their cowns released, before the callee runs.
+    /// The optimizer only emits tail calls once `Print` was stripped, so the
+    /// diagrams never show this.
+    InterpreterFrame*
+    tail_call_frame(Bytecode* body, size_t arg_ctn, bool discard_result)
+    {
+      auto current = frame_stack.back();
+      auto old_frame = current->frame;
+      auto new_frame = rt::make_frame(parent_stack_frame()->frame);
+
+      for (size_t i = 0; i < arg_ctn; i++)
       {
-        return ExecNext{};
+        auto value = old_frame->stack_pop("argument");
+        new_frame->stack_push(value, "argument", false);
+        rt::move_reference(old_frame->object(), new_frame->object(), value);
       }
+      rt::remove_reference(old_frame->object(), old_frame->object());
+
+      current->ip = 0;
+      current->body = body;
+      current->frame = new_frame;
+      current->discard_result |= discard_result;
+      current->require_result = !current->discard_result;
+      return current;
+    }
 
-      // ==========================================
-      // Operators that should be printed
-      // ==========================================
-      std::cout << "Op: " << node->type().str() << std::endl;
-      if (node == CreateObject)
+    /// Pops the current frame. The return value, if present, is transferred
+    /// to the stack of the calling frame.
+    ///
+    /// Returns the frame that should continue or `nullptr` if the program
+    /// finished.
+    InterpreterFrame*
+    return_frame(std::optional<rt::objects::DynObject*> return_value)
+    {
+      if (return_value.has_value())
       {
-        rt::objects::DynObject* obj = nullptr;
+        auto frame = frame_stack.back();
+        auto parent = parent_stack_frame();
+        auto value = return_value.value();
+        parent->frame->stack_push(value, "return", false);
+        rt::move_reference(
+          frame->frame->object(), parent->frame->object(), value);
+      }
 
-        assert(
-          !node->empty() && "CreateObject has to specify the type of data");
-        auto payload = node->at(0);
-        if (payload == Dictionary)
-        {
-          obj = rt::make_object();
-        }
-        else if (payload == String)
-        {
-          obj = rt::make_str(std::string(payload->location().view()));
-        }
-        else if (payload == KeyIter)
-        {
-          auto v = frame()->stack_pop("iterator source");
-          obj = rt::make_iter(v);
-          rt::remove_reference(frame()->object(), v);
-        }
-        else if (payload == Func)
-        {
-          assert(
-            payload->size() == 1 &&
-            "CreateObject: A bytecode function requires a body node");
-          obj = rt::make_func(new Bytecode{payload->at(0)});
-        }
-        else
-        {
-          assert(false && "CreateObject has to specify a value");
-        }
+      return pop_stack_frame();
+    }
+
+    /// Removes the reference of a value, that was popped from the stack of
+    /// the current frame, unless it was borrowed.
+    void release(rt::objects::DynObject* value, bool counted)
+    {
+      if (counted)
+      {
+        rt::remove_reference(frame()->object(), value);
+      }
+    }
 
-        // NO: rt::add_reference since objects are created with an rc of 1
-        frame()->stack_push(obj, "new object", false);
-        return ExecNext{};
+    void trace(const Instr& instr)
+    {
+      if (instr.op != Opcode::Print)
+      {
+        RT_LOG(Interp, Trace, "Op: " << opcode_name(instr.op));
       }
+    }
+
+  public:
+    Interpreter(rt::ui::UI* ui_, Profiler* profiler_)
+    : ui(ui_), profiler(profiler_)
+    {}
 
-      if (node == Null)
+    ~Interpreter()
+    {
+      for (auto frame : free_frames)
       {
-        frame()->stack_push(nullptr, "null");
-        return ExecNext{};
+        delete frame;
       }
+    }
+
+    void run(Bytecode* main)
+    {
+      InterpreterFrame* current = push_stack_frame(main);
+      const Instr* instr = nullptr;
+
+      // The handlers below are shared by both dispatch modes. `TARGET` marks
+      // the start of a handler and `DISPATCH` continues with the next
+      // instruction of the `current` frame.
+      //
+      // With threaded dispatch each handler jumps directly to the handler of
+      // the next instruction. Otherwise, it returns to the `switch`.
+#define FETCH() \
+  if (profiler) \
+  { \
+    profiler->next(current->body, current->ip); \
+  } \
+  instr = &current->body->code[current->ip++]; \
+  trace(*instr)
+
+#ifdef USE_THREADED_DISPATCH
+      static void* const dispatch_table[] = {
+#  define X(op, name) &&TARGET_##op,
+        FRANKENSCRIPT_OPCODES(X)
+#  undef X
+      };
+
+#  define TARGET(op) \
+    case Opcode::op: \
+    TARGET_##op:
+#  define DISPATCH() \
+    { \
+      FETCH(); \
+      goto* dispatch_table[static_cast<size_t>(instr->op)]; \
+    }
+#else
+#  define TARGET(op) case Opcode::op:
+#  define DISPATCH() continue
+#endif
 
-      if (node == LoadFrame)
+      while (true)
       {
-        std::string field{node->location().view()};
-        auto v = rt::get(frame()->object(), field);
-        if (!v)
+        FETCH();
+        switch (instr->op)
         {
-          if (field == "True")
-          {
-            v = rt::get_true();
-          }
-          else if (field == "False")
+          // ==========================================
+          // Operators that shouldn't be printed
+          // ==========================================
+          TARGET(Print)
           {
-            v = rt::get_false();
-          }
-        }
+            auto& text = current->body->names[instr->arg];
+            // The diagram shows the RCs and the stack
+            frame()->stack_reconcile();
+            // Console output
+            RT_LOG(Interp, Info, text << '\n');
 
-        if (!v)
-        {
-          std::stringstream ss;
-          ss << "The name " << field << " is undefined in the current frame";
-          rt::ui::error(ss.str(), frame()->object());
-        }
+            // Mermaid output
+            std::vector<rt::objects::DynObject*> roots{frame()->object()};
+            ui->output(roots, text);
 
-        frame()->stack_push(v.value(), "load from frame");
-        return ExecNext{};
-      }
+            DISPATCH();
+          }
 
-      if (node == LoadGlobal)
-      {
-        std::string field{node->location().view()};
+          // ==========================================
+          // Operators that should be printed
+          // ==========================================
+          TARGET(CreateDictionary)
+          {
+            // NO: rt::add_reference since objects are created with an rc of 1
+            frame()->stack_push(rt::make_object(), "new object", false);
+            DISPATCH();
+          }
 
-        // Local frame
-        auto v = rt::get(frame()->object(), field);
+          TARGET(CreateString)
+          {
+            // String constants live for the entire execution
+            auto obj = current->body->strings[instr->arg];
+            frame()->stack_push_borrowed(obj, "string constant");
+            DISPATCH();
+          }
 
-        // User globals
-        if (!v)
-        {
-          v = rt::get(global_frame()->object(), field);
-        }
+          TARGET(CreateKeyIter)
+          {
+            bool counted;
+            auto v = frame()->stack_pop("iterator source", counted);
+            auto obj = rt::make_iter(v);
+            release(v, counted);
+            frame()->stack_push(obj, "new object", false);
+            DISPATCH();
+          }
 
-        // Builtin globals
-        if (!v)
-        {
-          auto builtin = rt::get_builtin(field);
-          // Convert ptr -> optional
-          if (builtin)
+          TARGET(CreateFunc)
           {
-            v = builtin;
+            auto obj = rt::make_func(current->body->funcs[instr->arg].get());
+            frame()->stack_push(obj, "new object", false);
+            DISPATCH();
           }
-        }
 
-        if (!v)
-        {
-          std::stringstream ss;
-          ss << "The name `" << field
-             << "` is undefined in the current and global frame";
-          rt::ui::error(ss.str(), frame()->object());
-        }
+          TARGET(Null)
+          {
+            frame()->stack_push(nullptr, "null");
+            DISPATCH();
+          }
 
-        frame()->stack_push(v.value(), "load from global");
-        return ExecNext{};
-      }
+          TARGET(LoadFrame)
+          {
+            auto field = rt::Atom{instr->arg};
+            auto v = rt::get(frame()->object(), field);
+            if (!v)
+            {
+              auto& name = rt::atom_name(field);
+              if (name == "True")
+              {
+                v = rt::get_true();
+              }
+              else if (name == "False")
+              {
+                v = rt::get_false();
+              }
+            }
 
-      if (node == StoreFrame)
-      {
-        if (frame()->get_stack_size() < 1)
-        {
-          rt::ui::error("Interpreter: The stack is too small");
-        }
-        auto v = frame()->stack_pop("value to store");
-        std::string field{node->location().view()};
-        auto v2 = rt::set(frame()->object(), field, v);
-        rt::remove_reference(frame()->object(), v2);
-        return ExecNext{};
-      }
+            if (!v)
+            {
+              std::stringstream ss;
+              ss << "The name " << rt::atom_name(field)
+                 << " is undefined in the current frame";
+              rt::ui::error(ss.str(), frame()->object());
+            }
 
-      if (node == SwapFrame)
-      {
-        if (frame()->get_stack_size() < 1)
-        {
-          rt::ui::error("Interpreter: The stack is too small");
-        }
-        auto new_var = frame()->stack_pop("swap value");
-        std::string field{node->location().view()};
+            // The local keeps the value alive, see `stack_reconcile`
+            frame()->stack_push_borrowed(v.value(), "load from frame");
+            DISPATCH();
+          }
 
-        auto old_var = rt::set(frame()->object(), field, new_var);
-        // RC stays the same
-        frame()->stack_push(old_var, "swaped", false);
+          TARGET(LoadGlobal)
+          {
+            auto& cache = current->body->global_caches[instr->arg];
+            auto field = cache.name;
 
-        return ExecNext{};
-      }
+            // Local frame
+            auto v = rt::get(frame()->object(), field, cache.local);
 
-      if (node == LoadField)
-      {
-        if (frame()->get_stack_size() < 2)
-        {
-          rt::ui::error("Interpreter: The stack is too small");
-        }
-        auto k = frame()->stack_pop("lookup-key");
-        auto v = frame()->stack_pop("lookup-value");
+            // User globals
+            if (!v)
+            {
+              v = rt::get(global_frame()->object(), field, cache.global);
+            }
 
-        if (!v)
-        {
-          std::stringstream ss;
-          ss << "Tried to access the field `" << rt::get_key(k)
-             << "` on `None`";
-          rt::ui::error(ss.str(), nullptr);
-        }
+            // Builtin globals, these are never replaced or deallocated
+            if (!v)
+            {
+              if (!cache.builtin)
+              {
+                cache.builtin = rt::get_builtin(field);
+              }
+              // Convert ptr -> optional
+              if (cache.builtin)
+              {
+                v = cache.builtin;
+              }
+            }
 
-        auto v2 = rt::get(v, k);
-        if (!v2)
-        {
-          std::stringstream ss;
-          ss << "the field `" << rt::get_key(k) << "` is not defined on " << v;
-          rt::ui::error(ss.str(), v);
-        }
+            if (!v)
+            {
+              std::stringstream ss;
+              ss << "The name `" << rt::atom_name(field)
+                 << "` is undefined in the current and global frame";
+              rt::ui::error(ss.str(), frame()->object());
+            }
 
-        frame()->stack_push(v2.value(), "loaded field");
-        rt::remove_reference(frame()->object(), k);
-        rt::remove_reference(frame()->object(), v);
-        return ExecNext{};
-      }
+            // The locals of the current and the global frame only change in
+            // the current frame. Builtins live for the entire execution.
+            frame()->stack_push_borrowed(v.value(), "load from global");
+            DISPATCH();
+          }
 
-      if (node == StoreField)
-      {
-        if (frame()->get_stack_size() < 3)
-        {
-          rt::ui::error("Interpreter: The stack is too small");
-        }
-        auto v = frame()->stack_pop("value to store");
-        auto k = frame()->stack_pop("lookup-key");
-        auto v2 = frame()->stack_pop("lookup-value");
-        auto v3 = rt::set(v2, k, v);
-        rt::move_reference(frame()->object(), v2, v);
-        rt::remove_reference(frame()->object(), k);
-        rt::remove_reference(frame()->object(), v2);
-        rt::remove_reference(v2, v3);
-        return ExecNext{};
-      }
+          TARGET(StoreFrame)
+          {
+            if (frame()->get_stack_size() < 1)
+            {
+              rt::ui::error("Interpreter: The stack is too small");
+            }
+            auto v = frame()->stack_pop("value to store");
+            // Borrowed entries might depend on the overwritten local
+            frame()->stack_reconcile();
+            auto v2 =
+              rt::set(frame()->object(), rt::Atom{instr->arg}, v);
+            rt::remove_reference(frame()->object(), v2);
+            DISPATCH();
+          }
 
-      if (node == SwapField)
-      {
-        if (frame()->get_stack_size() < 3)
-        {
-          rt::ui::error("Interpreter: The stack is too small");
-        }
-        auto new_var = frame()->stack_pop("swap value");
-        auto key = frame()->stack_pop("lookup-key");
-        auto obj = frame()->stack_pop("lookup-value");
-        auto old_var = rt::set(obj, key, new_var);
-        // RC stays the same
-        frame()->stack_push(old_var, "swapped value", false);
-
-        rt::move_reference(obj, frame()->object(), old_var);
-        rt::move_reference(frame()->object(), obj, new_var);
-        rt::remove_reference(frame()->object(), obj);
-        rt::remove_reference(frame()->object(), key);
-
-        return ExecNext{};
-      }
+          TARGET(SwapFrame)
+          {
+            if (frame()->get_stack_size() < 1)
+            {
+              rt::ui::error("Interpreter: The stack is too small");
+            }
+            auto new_var = frame()->stack_pop("swap value");
+            frame()->stack_reconcile();
+            auto old_var = rt::set(
+              frame()->object(), rt::Atom{instr->arg}, new_var);
+            // RC stays the same
+            frame()->stack_push(old_var, "swaped", false);
+
+            DISPATCH();
+          }
 
-      if (node == Eq || node == Neq)
-      {
-        auto b = frame()->stack_pop("Rhs");
-        auto a = frame()->stack_pop("Lhs");
+          TARGET(LoadField)
+          {
+            if (frame()->get_stack_size() < 2)
+            {
+              rt::ui::error("Interpreter: The stack is too small");
+            }
+            bool k_counted;
+            bool v_counted;
+            auto k = frame()->stack_pop("lookup-key", k_counted);
+            auto v = frame()->stack_pop("lookup-value", v_counted);
 
-        auto bool_result = (a == b);
-        if (node == Neq)
-        {
-          bool_result = !bool_result;
-        }
+            if (!v)
+            {
+              std::stringstream ss;
+              ss << "Tried to access the field `" << rt::get_key(k)
+                 << "` on `None`";
+              rt::ui::error(ss.str(), nullptr);
+            }
 
-        const char* result_str;
-        rt::objects::DynObject* result;
-        if (bool_result)
-        {
-          result = rt::get_true();
-          result_str = "true";
-        }
-        else
-        {
-          result = rt::get_false();
-          result_str = "false";
-        }
-        frame()->stack_push(result, result_str);
+            auto v2 = rt::get(v, k, current->body->field_caches[instr->arg]);
+            if (!v2)
+            {
+              std::stringstream ss;
+              ss << "the field `" << rt::get_key(k) << "` is not defined on "
+                 << v;
+              rt::ui::error(ss.str(), v);
+            }
 
-        rt::remove_reference(frame()->object(), a);
-        rt::remove_reference(frame()->object(), b);
-        return ExecNext{};
-      }
+            frame()->stack_push(v2.value(), "loaded field");
+            release(k, k_counted);
+            release(v, v_counted);
+            DISPATCH();
+          }
 
-      if (node == Jump)
-      {
-        return ExecJump{node->location()};
-      }
+          TARGET(StoreField)
+          {
+            if (frame()->get_stack_size() < 3)
+            {
+              rt::ui::error("Interpreter: The stack is too small");
+            }
+            bool k_counted;
+            bool v2_counted;
+            auto v = frame()->stack_pop("value to store");
+            auto k = frame()->stack_pop("lookup-key", k_counted);
+            auto v2 = frame()->stack_pop("lookup-value", v2_counted);
+            auto v3 = rt::set(v2, k, v);
+            rt::move_reference(frame()->object(), v2, v);
+            release(k, k_counted);
+            release(v2, v2_counted);
+            rt::remove_reference(v2, v3);
+            DISPATCH();
+          }
 
-      if (node == JumpFalse)
-      {
-        auto v = frame()->stack_pop("jump condition");
-        auto jump = (v == rt::get_false());
-        rt::remove_reference(frame()->object(), v);
-        if (jump)
-        {
-          return ExecJump{node->location()};
-        }
-        else
-        {
-          return ExecNext{};
-        }
-      }
+          TARGET(SwapField)
+          {
+            if (frame()->get_stack_size() < 3)
+            {
+              rt::ui::error("Interpreter: The stack is too small");
+            }
+            frame()->stack_reconcile();
+            auto new_var = frame()->stack_pop("swap value");
+            auto key = frame()->stack_pop("lookup-key");
+            auto obj = frame()->stack_pop("lookup-value");
+            auto old_var = rt::set(obj, key, new_var);
+            // RC stays the same
+            frame()->stack_push(old_var, "swapped value", false);
+
+            rt::move_reference(obj, frame()->object(), old_var);
+            rt::move_reference(frame()->object(), obj, new_var);
+            rt::remove_reference(frame()->object(), obj);
+            rt::remove_reference(frame()->object(), key);
+
+            DISPATCH();
+          }
 
-      if (node == IterNext)
-      {
-        auto it = frame()->stack_pop("iterator");
+          TARGET(Eq)
+          TARGET(Neq)
+          {
+            bool a_counted;
+            bool b_counted;
+            auto b = frame()->stack_pop("Rhs", b_counted);
+            auto a = frame()->stack_pop("Lhs", a_counted);
 
-        auto obj = rt::iter_next(it);
-        rt::remove_reference(frame()->object(), it);
+            auto bool_result = (a == b);
+            if (instr->op == Opcode::Neq)
+            {
+              bool_result = !bool_result;
+            }
 
-        frame()->stack_push(obj, "next from iter", false);
-        return ExecNext{};
-      }
+            const char* result_str;
+            rt::objects::DynObject* result;
+            if (bool_result)
+            {
+              result = rt::get_true();
+              result_str = "true";
+            }
+            else
+            {
+              result = rt::get_false();
+              result_str = "false";
+            }
+            // The booleans live for the entire execution
+            frame()->stack_push_borrowed(result, result_str);
 
-      if (node == ClearStack)
-      {
-        while (!frame()->stack_is_empty())
-        {
-          auto value = frame()->stack_pop("value to clear");
-          rt::remove_reference(frame()->object(), value);
-        }
-        return ExecNext{};
-      }
+            release(a, a_counted);
+            release(b, b_counted);
+            DISPATCH();
+          }
 
-      if (node == Call)
-      {
-        auto func = frame()->stack_pop("function");
-        auto arg_ctn = std::stoul(std::string(node->location().view()));
+          TARGET(Jump)
+          {
+            current->ip = instr->arg;
+            DISPATCH();
+          }
 
-        if (auto bytecode = rt::try_get_bytecode(func))
-        {
-          rt::remove_reference(frame()->object(), func);
-          return ExecFunc{bytecode.value()->body, arg_ctn};
-        }
-        else if (auto builtin = rt::try_get_builtin_func(func))
-        {
-          // This calls the built-in function with the current frame and current
-          // stack. This makes the implementation on the interpreter side a lot
-          // easier and makes builtins more powerful. The tradeoff is that the
-          // arguments are still in reverse order on the stack, and the function
-          // can potentially modify the "calling" frame.
-          auto result = (builtin.value())(frame(), arg_ctn);
-          if (result)
+          TARGET(JumpFalse)
           {
-            auto value = result.value();
-            frame()->stack_push(value, "result from builtin", false);
+            bool counted;
+            auto v = frame()->stack_pop("jump condition", counted);
+            auto jump = (v == rt::get_false());
+            release(v, counted);
+            if (jump)
+            {
+              current->ip = instr->arg;
+            }
+            DISPATCH();
           }
-          rt::remove_reference(frame()->object(), func);
-          return ExecNext{};
-        }
-        else
-        {
-          rt::ui::error("Object is not a function", func);
-        }
-      }
 
-      if (node == Dup)
-      {
-        // This breaks the normal idea of a stack machine, but every other
-        // solution would require more effort and would be messier
-        auto dup_idx = std::stoul(std::string(node->location().view()));
-        auto stack_size = frame()->get_stack_size();
-        if (dup_idx > stack_size)
-        {
-          rt::ui::error(
-            "Interpreter: the stack is too small for this duplication");
-        }
+          TARGET(IterNext)
+          {
+            bool counted;
+            auto it = frame()->stack_pop("iterator", counted);
 
-        auto var = frame()->stack_get(stack_size - dup_idx - 1);
-        frame()->stack_push(var, "duplicated value");
+            auto obj = rt::iter_next(it);
+            release(it, counted);
 
-        return ExecNext{};
-      }
+            frame()->stack_push(obj, "next from iter", false);
+            DISPATCH();
+          }
 
-      if (node == Return)
-      {
-        return ExecReturn{};
-      }
+          TARGET(ClearStack)
+          {
+            while (!frame()->stack_is_empty())
+            {
+              bool counted;
+              auto value = frame()->stack_pop("value to clear", counted);
+              release(value, counted);
+            }
+            DISPATCH();
+          }
 
-      if (node == ReturnValue)
-      {
-        auto value = frame()->stack_pop("return value");
-        // RC is transfered to the stack of the parent frame
-        return ExecReturn{value};
-      }
+          TARGET(Call)
+          TARGET(TailCall)
+          TARGET(TailCallDiscard)
+          {
+            // The arguments are moved to the new frame and builtins observe
+            // the stack
+            frame()->stack_reconcile();
+            auto func = frame()->stack_pop("function");
+            size_t arg_ctn = instr->arg;
 
-      std::cerr << "unhandled bytecode" << std::endl;
-      node->str(std::cerr);
-      std::abort();
-    }
+            if (auto bytecode = rt::try_get_bytecode(func))
+            {
+              rt::remove_reference(frame()->object(), func);
+              // The global frame can't be replaced. Discarding the result
+              // of a frame, that has to return a value, has to fail once
+              // the call returned.
+              auto tail_call = frame_stack.size() > 1 &&
+                (instr->op == Opcode::TailCall ||
+                 (instr->op == Opcode::TailCallDiscard &&
+                  !current->require_result));
+              if (!tail_call)
+              {
+                // The stored ip already continues after the call
+                current = call_frame(bytecode.value(), arg_ctn);
+              }
+              else
+              {
+                current = tail_call_frame(
+                  bytecode.value(),
+                  arg_ctn,
+                  instr->op == Opcode::TailCallDiscard);
+              }
+            }
+            else if (auto builtin = rt::try_get_builtin_func(func))
+            {
+              // This calls the built-in function with the current frame and
+              // current stack. This makes the implementation on the
+              // interpreter side a lot easier and makes builtins more
+              // powerful. The tradeoff is that the arguments are still in
+              // reverse order on the stack, and the function can potentially
+              // modify the "calling" frame.
+              auto result = (builtin.value())(frame(), arg_ctn);
+              if (result)
+              {
+                auto value = result.value();
+                frame()->stack_push(value, "result from builtin", false);
+              }
+              rt::remove_reference(frame()->object(), func);
+            }
+            else
+            {
+              rt::ui::error("Object is not a function", func);
+            }
+            DISPATCH();
+          }
 
-  public:
-    Interpreter(rt::ui::UI* ui_) : ui(ui_) {}
+          TARGET(Dup)
+          {
+            // This breaks the normal idea of a stack machine, but every other
+            // solution would require more effort and would be messier
+            size_t dup_idx = instr->arg;
+            auto stack_size = frame()->get_stack_size();
+            if (dup_idx > stack_size)
+            {
+              rt::ui::error(
+                "Interpreter: the stack is too small for this duplication");
+            }
 
-    void run(trieste::Node main)
-    {
-      auto frame = push_stack_frame(main);
+            auto var = frame()->stack_get(stack_size - dup_idx - 1);
+            frame()->stack_push(var, "duplicated value");
 
-      while (frame)
-      {
-        const auto action = run_stmt(*frame->ip);
+            DISPATCH();
+          }
 
-        if (std::holds_alternative<ExecNext>(action))
-        {
-          frame->ip++;
-        }
-        else if (std::holds_alternative<ExecJump>(action))
-        {
-          auto jump = std::get<ExecJump>(action);
-          auto label_node = frame->body->look(jump.target);
-          assert(label_node.size() == 1);
-          frame->ip = frame->body->find(label_node[0]);
-          // Skip the label node
-          frame->ip++;
-        }
-        else if (std::holds_alternative<ExecFunc>(action))
-        {
-          auto func = std::get<ExecFunc>(action);
+          TARGET(LoadFieldConst)
+          {
+            if (frame()->get_stack_size() < 1)
+            {
+              rt::ui::error("Interpreter: The stack is too small");
+            }
+            auto& cache = current->body->field_caches[instr->arg];
+            bool counted;
+            auto v = frame()->stack_pop("lookup-value", counted);
+
+            if (!v)
+            {
+              std::stringstream ss;
+              ss << "Tried to access the field `" << rt::atom_name(cache.key)
+                 << "` on `None`";
+              rt::ui::error(ss.str(), nullptr);
+            }
 
-          // Make sure the stored ip, continues after the call
-          frame->ip++;
+            auto v2 = rt::get(v, cache.key, cache);
+            if (!v2)
+            {
+              std::stringstream ss;
+              ss << "the field `" << rt::atom_name(cache.key)
+                 << "` is not defined on " << v;
+              rt::ui::error(ss.str(), v);
+            }
 
-          frame = push_stack_frame(func.body);
-          auto parent_frame = parent_stack_frame();
+            frame()->stack_push(v2.value(), "loaded field");
+            release(v, counted);
+            DISPATCH();
+          }
 
-          // Setup the new frame
-          for (size_t i = 0; i < func.arg_ctn; i++)
+          TARGET(StoreFieldConst)
           {
-            auto value = parent_frame->frame->stack_pop("argument");
-            frame->frame->stack_push(value, "argument", false);
-            rt::move_reference(
-              parent_frame->frame->object(), frame->frame->object(), value);
+            if (frame()->get_stack_size() < 2)
+            {
+              rt::ui::error("Interpreter: The stack is too small");
+            }
+            bool counted;
+            auto v = frame()->stack_pop("value to store");
+            auto v2 = frame()->stack_pop("lookup-value", counted);
+            auto v3 = rt::set(v2, rt::Atom{instr->arg}, v);
+            rt::move_reference(frame()->object(), v2, v);
+            release(v2, counted);
+            rt::remove_reference(v2, v3);
+            DISPATCH();
           }
-        }
-        else if (std::holds_alternative<ExecReturn>(action))
-        {
-          frame->ip = frame->body->end();
-        }
-        else
-        {
-          assert(false && "unhandled statement action");
-        }
 
-        if (frame->ip == frame->body->end())
-        {
-          if (std::holds_alternative<ExecReturn>(action))
+          TARGET(MoveFrame)
+          {
+            frame()->stack_reconcile();
+            auto old_var =
+              rt::set(frame()->object(), rt::Atom{instr->arg}, nullptr);
+            // RC is transfered from the frame to the stack
+            frame()->stack_push(old_var, "moved", false);
+            DISPATCH();
+          }
+
+          TARGET(Return)
           {
-            auto return_ = std::get<ExecReturn>(action);
-            if (return_.value.has_value())
+            if (current->require_result)
+            {
+              // The replaced frame would fail to pop the missing result
+              rt::ui::error("Interpreter: The stack is too small");
+            }
+            frame()->stack_reconcile();
+            current = return_frame(std::nullopt);
+            if (!current)
             {
-              auto parent = parent_stack_frame();
-              auto value = return_.value.value();
-              parent->frame->stack_push(value, "return", false);
-              rt::move_reference(
-                frame->frame->object(), parent->frame->object(), value);
+              return;
             }
+            DISPATCH();
           }
 
-          frame = pop_stack_frame();
+          TARGET(ReturnValue)
+          {
+            auto value = frame()->stack_pop("return value");
+            frame()->stack_reconcile();
+            if (current->discard_result)
+            {
+              rt::remove_reference(frame()->object(), value);
+              current = return_frame(std::nullopt);
+            }
+            else
+            {
+              // RC is transfered to the stack of the parent frame
+              current = return_frame(value);
+            }
+            if (!current)
+            {
+              return;
+            }
+            DISPATCH();
+          }
         }
+
+        std::cerr << "unhandled bytecode: " << opcode_name(instr->op)
+                  << std::endl;
+        std::abort();
       }
+
+#undef TARGET
+#undef DISPATCH
+#undef FETCH
     }
   };
 
-  void start(trieste::Node main_body, int step_counter, std::string output)
+  void start(
+    Bytecode* main_body,
+    int step_counter,
+    std::string output,
+    Profiler* profiler)
   {
     auto ui = rt::ui::globalUI();
     ui->set_output_file(output);
@@ -560,8 +754,12 @@ namespace verona::interpreter
 
     size_t initial = rt::pre_run(ui);
 
-    Interpreter inter(ui);
+    Interpreter inter(ui, profiler);
     inter.run(main_body);
+    if (profiler)
+    {
+      profiler->stop();
+    }
 
     rt::post_run(initial, ui);
   }
@@ -11,8 +11,6 @@ namespace verona::interpreter
 {
   struct Bytecode;
 
-  void delete_bytecode(Bytecode* bytecode);
-
   class FrameObj
   {
   public:
@@ -22,9 +20,21 @@ namespace verona::interpreter
     /// `rc_add` is set to false
     virtual void stack_push(
       rt::objects::DynObject* value, const char* info, bool rc_add = true) = 0;
+    /// This pushes a reference without increasing the RC. The value has to
+    /// stay referenced by the frame, for example by a local, or be immortal,
+    /// until the entry is popped or the stack is reconciled.
+    virtual void
+    stack_push_borrowed(rt::objects::DynObject* value, const char* info) = 0;
     /// This pops the value from the stack. The RC change has to be done by the
-    /// caller.
+    /// caller. Borrowed entries are counted first.
     virtual rt::objects::DynObject* stack_pop(char const* info) = 0;
+    /// This pops the value from the stack. `counted` is false for borrowed
+    /// entries, the caller only has to remove the reference if it is set.
+    virtual rt::objects::DynObject*
+    stack_pop(char const* info, bool& counted) = 0;
+    /// Counts the references of all borrowed entries. This has to happen
+    /// before the stack is observed or the frame changes the locals.
+    virtual void stack_reconcile() = 0;
     virtual size_t get_stack_size() = 0;
     virtual rt::objects::DynObject* stack_get(size_t index) = 0;
 
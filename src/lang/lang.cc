@@ -1,8 +1,13 @@
 #include "lang.h"
 
+#include "../rt/log.h"
+#include "../rt/ui.h"
+#include "cache.h"
 #include "interpreter.h"
+#include "profiler.h"
 #include "trieste/driver.h"
 
+#include <fstream>
 #include <limits>
 #include <optional>
 
@@ -22,13 +27,23 @@ std::pair<PassDef, std::shared_ptr<std::optional<Node>>> extract_bytecode_pass()
 
 namespace verona::interpreter
 {
-  void start(trieste::Node main_body, int step_counter, std::string output);
+  void start(
+    Bytecode* main_body,
+    int step_counter,
+    std::string output,
+    Profiler* profiler);
 }
 
 struct CLIOptions : trieste::Options
 {
   int step_counter = std::numeric_limits<int>::max();
   std::string out = "mermaid.md";
+  std::string ui = "mermaid";
+  std::string log_level = "trace";
+  std::vector<std::string> log_settings;
+  bool cache = false;
+  std::string profile;
+  bool object_registry = true;
 
   void configure(CLI::App& app)
   {
@@ -41,6 +56,33 @@ struct CLIOptions : trieste::Options
       step_counter,
       "Step n instructions before entering interactive mode");
     app.add_option("--out", out, "The output file for frankenscript");
+    app.add_option(
+      "--ui",
+      ui,
+      "The UI backend: mermaid (default) or none, which skips all diagrams");
+    app.add_option(
+      "--log-level",
+      log_level,
+      "The log level of all categories: none, info or trace");
+    app.add_option(
+      "--log",
+      log_settings,
+      "The log level of a single category, like `rc=none`. The categories "
+      "are: rc, alloc, stack, region and interp");
+    app.add_flag(
+      "--cache",
+      [&](auto) { cache = true; },
+      "Read and write the bytecode cache (.frankc), next to the program");
+    app.add_option(
+      "--profile",
+      profile,
+      "Profile the execution per opcode and per line. The results are "
+      "printed as a table and written as JSON to the given file");
+    app.add_flag(
+      "--no-object-registry",
+      [&](auto) { object_registry = false; },
+      "Only count the objects. Leaks are still detected, but the leaked and "
+      "unreachable objects are not shown");
   }
 
   void validate()
@@ -51,11 +93,118 @@ struct CLIOptions : trieste::Options
                 << std::endl;
       exit(-1);
     }
+
+    if (!rt::ui::select_ui(ui))
+    {
+      std::cerr << "Unknown UI backend: " << ui << std::endl;
+      exit(-1);
+    }
+
+    auto level = rt::log::parse_level(log_level);
+    if (!level)
+    {
+      std::cerr << "Unknown log level: " << log_level << std::endl;
+      exit(-1);
+    }
+    rt::log::set_level(level.value());
+    rt::enable_object_registry(object_registry);
+
+    for (auto& setting : log_settings)
+    {
+      if (!rt::log::apply_setting(setting))
+      {
+        std::cerr << "Invalid log setting: " << setting << std::endl;
+        exit(-1);
+      }
+    }
   }
 };
 
+/// Parses a command line, that builds a single file and only uses the options
+/// of frankenscript. Returns the path of the file or `std::nullopt` for all
+/// other command lines, these are left to the trieste driver.
+std::optional<std::string>
+parse_build_command(int argc, char** argv, CLIOptions& options)
+{
+  CLI::App app;
+  auto build = app.add_subcommand("build");
+  options.configure(*build);
+  std::string path;
+  build->add_option("path", path)->required();
+  app.require_subcommand(1);
+
+  try
+  {
+    app.parse(argc, argv);
+  }
+  catch (const CLI::Error&)
+  {
+    return std::nullopt;
+  }
+  return path;
+}
+
+void run(verona::interpreter::Bytecode* main_body, CLIOptions& options)
+{
+  // `Print` is only needed, if its output is displayed somewhere
+  auto keep_print = rt::ui::globalUI()->is_mermaid() ||
+    rt::log::enabled(rt::log::Category::Interp, rt::log::Level::Info);
+  verona::interpreter::optimize(main_body, keep_print);
+
+  std::optional<verona::interpreter::Profiler> profiler;
+  if (!options.profile.empty())
+  {
+    profiler.emplace();
+  }
+
+  verona::interpreter::start(
+    main_body,
+    options.step_counter,
+    options.out,
+    profiler ? &profiler.value() : nullptr);
+
+  if (profiler)
+  {
+    std::cout << std::endl << "Profile:" << std::endl;
+    profiler->write_table(std::cout);
+
+    std::ofstream json(options.profile);
+    if (!json)
+    {
+      std::cerr << "Unable to write the profile to " << options.profile
+                << std::endl;
+      return;
+    }
+    profiler->write_json(json);
+  }
+}
+
 int load_trieste(int argc, char** argv)
 {
+  // Programs with a valid bytecode cache skip the parser and all passes
+  CLIOptions cache_options;
+  auto source = parse_build_command(argc, argv, cache_options);
+  if (source)
+  {
+    // Loading the cache already allocates the string constants, which have
+    // to respect the log and registry options
+    cache_options.validate();
+  }
+  if (source && cache_options.cache)
+  {
+    if (auto main_body = verona::interpreter::load_cache(source.value()))
+    {
+      RT_LOG(
+        Interp,
+        Info,
+        "Loaded the bytecode cache: "
+          << verona::interpreter::cache_path(source.value()));
+      RT_LOG(Interp, Info, "Output file: " << cache_options.out);
+      run(main_body.get(), cache_options);
+      return 0;
+    }
+  }
+
   CLIOptions options;
   auto [extract_bytecode, result] = extract_bytecode_pass();
   trieste::Reader reader{
@@ -65,14 +214,23 @@ int load_trieste(int argc, char** argv)
   trieste::Driver driver{reader, &options};
   auto build_res = driver.run(argc, argv);
 
-  options.validate();
+  // The options of a build command were validated above, the UI can only be
+  // selected once
+  if (!source)
+  {
+    options.validate();
+  }
 
-  std::cout << "Output file: " << options.out << std::endl;
+  RT_LOG(Interp, Info, "Output file: " << options.out);
 
   if (build_res == 0 && result->has_value())
   {
-    verona::interpreter::start(
-      result->value(), options.step_counter, options.out);
+    auto main_body = verona::interpreter::lower(result->value());
+    if (source && cache_options.cache)
+    {
+      verona::interpreter::store_cache(source.value(), main_body.get());
+    }
+    run(main_body.get(), options);
   }
   return build_res;
 }
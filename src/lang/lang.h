@@ -1,6 +1,7 @@
 #pragma once
 
 #include "bytecode.h"
+#include "instr.h"
 #include "trieste/trieste.h"
 
 using namespace trieste;
@@ -81,6 +82,13 @@ PassDef call_stmts();
 PassDef flatten();
 PassDef bytecode();
 
+namespace verona::interpreter
+{
+  /// Lowers a bytecode `Body` into the flat instruction format, that is
+  /// executed by the interpreter.
+  std::unique_ptr<Bytecode> lower(Node body);
+}
+
 inline Node create_print(size_t line, std::string text)
 {
   std::stringstream ss;
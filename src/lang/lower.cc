@@ -0,0 +1,248 @@
+#include "../rt/rt.h"
+#include "instr.h"
+#include "lang.h"
+
+#include <charconv>
+#include <map>
+
+namespace verona::interpreter
+{
+  class Lowering
+  {
+    Bytecode* result;
+    std::map<std::string, uint32_t, std::less<>> name_ids;
+    /// Maps label names to the index of the instruction following the label.
+    std::map<std::string_view, uint32_t> labels;
+    /// Jump instructions, that still need to be resolved, with the name of
+    /// their target label.
+    std::vector<std::pair<size_t, std::string_view>> jumps;
+
+    uint32_t name(std::string_view value)
+    {
+      auto search = name_ids.find(value);
+      if (search != name_ids.end())
+      {
+        return search->second;
+      }
+
+      auto id = static_cast<uint32_t>(result->names.size());
+      result->names.emplace_back(value);
+      name_ids.emplace(std::string(value), id);
+      return id;
+    }
+
+    /// Interns the given name, this allows the interpreter to access fields
+    /// without comparing strings.
+    uint32_t atom(std::string_view value)
+    {
+      return static_cast<uint32_t>(rt::intern(value));
+    }
+
+    uint32_t string(std::string_view value)
+    {
+      auto id = static_cast<uint32_t>(result->strings.size());
+      result->strings.push_back(rt::get_str_constant(value));
+      return id;
+    }
+
+    uint32_t field_cache()
+    {
+      auto id = static_cast<uint32_t>(result->field_caches.size());
+      result->field_caches.emplace_back();
+      return id;
+    }
+
+    uint32_t global_cache(std::string_view value)
+    {
+      auto id = static_cast<uint32_t>(result->global_caches.size());
+      result->global_caches.push_back({rt::intern(value)});
+      return id;
+    }
+
+    uint32_t number(Node node)
+    {
+      return static_cast<uint32_t>(
+        std::stoul(std::string(node->location().view())));
+    }
+
+    Instr lower_create(Node node)
+    {
+      assert(!node->empty() && "CreateObject has to specify the type of data");
+      auto payload = node->at(0);
+      if (payload == Dictionary)
+      {
+        return {Opcode::CreateDictionary};
+      }
+      else if (payload == String)
+      {
+        return {Opcode::CreateString, string(payload->location().view())};
+      }
+      else if (payload == KeyIter)
+      {
+        return {Opcode::CreateKeyIter};
+      }
+      else if (payload == Func)
+      {
+        assert(
+          payload->size() == 1 &&
+          "CreateObject: A bytecode function requires a body node");
+        auto id = static_cast<uint32_t>(result->funcs.size());
+        result->funcs.push_back(lower(payload->at(0)));
+        return {Opcode::CreateFunc, id};
+      }
+
+      std::cerr << "CreateObject has to specify a value" << std::endl;
+      node->str(std::cerr);
+      std::abort();
+    }
+
+    Instr lower_stmt(Node node)
+    {
+      if (node == LoadFrame)
+        return {Opcode::LoadFrame, atom(node->location().view())};
+      if (node == LoadGlobal)
+        return {Opcode::LoadGlobal, global_cache(node->location().view())};
+      if (node == StoreFrame)
+        return {Opcode::StoreFrame, atom(node->location().view())};
+      if (node == SwapFrame)
+        return {Opcode::SwapFrame, atom(node->location().view())};
+      if (node == LoadField)
+        return {Opcode::LoadField, field_cache()};
+      if (node == StoreField)
+        return {Opcode::StoreField};
+      if (node == SwapField)
+        return {Opcode::SwapField};
+      if (node == CreateObject)
+        return lower_create(node);
+      if (node == Null)
+        return {Opcode::Null};
+      if (node == Eq)
+        return {Opcode::Eq};
+      if (node == Neq)
+        return {Opcode::Neq};
+      if (node == Jump)
+        return {Opcode::Jump};
+      if (node == JumpFalse)
+        return {Opcode::JumpFalse};
+      if (node == IterNext)
+        return {Opcode::IterNext};
+      if (node == Print)
+        return {Opcode::Print, name(node->location().view())};
+      if (node == Call)
+        return {Opcode::Call, number(node)};
+      if (node == Return)
+        return {Opcode::Return};
+      if (node == ReturnValue)
+        return {Opcode::ReturnValue};
+      if (node == ClearStack)
+        return {Opcode::ClearStack};
+      if (node == Dup)
+        return {Opcode::Dup, number(node)};
+
+      std::cerr << "unhandled bytecode" << std::endl;
+      node->str(std::cerr);
+      std::abort();
+    }
+
+    /// Extracts the line number from the text of a `Print`, which has the
+    /// form `Line <n>: <text>`. (See `create_print`)
+    uint32_t print_line(const std::string& text)
+    {
+      std::string_view prefix = "Line ";
+      uint32_t line = 0;
+      if (text.starts_with(prefix))
+      {
+        std::from_chars(
+          text.data() + prefix.size(), text.data() + text.size(), line);
+      }
+      return line;
+    }
+
+  public:
+    Lowering(Bytecode* result_) : result(result_) {}
+
+    /// Assigns a source line to each instruction. The code of a statement
+    /// is followed by the `Print` with its line, instructions therefore
+    /// belong to the next `Print`. Instructions after the last `Print` belong
+    /// to the line of that `Print`.
+    void assign_lines()
+    {
+      auto& code = result->code;
+      result->lines.assign(code.size(), 0);
+
+      uint32_t line = 0;
+      for (size_t i = code.size(); i-- > 0;)
+      {
+        if (code[i].op == Opcode::Print)
+        {
+          line = print_line(result->names[code[i].arg]);
+        }
+        result->lines[i] = line;
+      }
+
+      line = 0;
+      for (size_t i = 0; i < code.size(); i++)
+      {
+        if (code[i].op == Opcode::Print)
+        {
+          line = result->lines[i];
+        }
+        else if (result->lines[i] == 0)
+        {
+          result->lines[i] = line;
+        }
+      }
+    }
+
+    /// Replaces the label of each jump with the index of the target
+    /// instruction. This is done once, so jumps at runtime are O(1).
+    void resolve_labels()
+    {
+      for (auto [idx, label] : jumps)
+      {
+        auto target = labels.find(label);
+        if (target == labels.end())
+        {
+          std::cerr << "unknown jump target: " << label << std::endl;
+          std::abort();
+        }
+        result->code[idx].arg = target->second;
+      }
+    }
+
+    void run(Node body)
+    {
+      result->code.reserve(body->size());
+      for (auto& stmt : *body)
+      {
+        // Labels only mark jump targets, they are not part of the code
+        if (stmt == Label)
+        {
+          auto id = static_cast<uint32_t>(result->code.size());
+          labels[stmt->at(0)->location().view()] = id;
+          continue;
+        }
+
+        if (stmt == Jump || stmt == JumpFalse)
+        {
+          jumps.push_back({result->code.size(), stmt->location().view()});
+        }
+
+        result->code.push_back(lower_stmt(stmt));
+      }
+
+      // Falling off the end of a body returns without a value
+      result->code.push_back({Opcode::Return});
+
+      resolve_labels();
+      assign_lines();
+    }
+  };
+
+  std::unique_ptr<Bytecode> lower(Node body)
+  {
+    auto result = std::make_unique<Bytecode>();
+    Lowering(result.get()).run(body);
+    return result;
+  }
+} // namespace verona::interpreter
@@ -0,0 +1,301 @@
+#include "../rt/rt.h"
+#include "instr.h"
+
+#include <functional>
+#include <optional>
+
+namespace verona::interpreter
+{
+  class Optimizer
+  {
+    /// Rewrites the code at `idx` and appends the result to `out`. Returns the
+    /// number of consumed instructions or 0, if nothing was rewritten.
+    using Rule = std::function<size_t(size_t idx, std::vector<Instr>& out)>;
+
+    Bytecode* body;
+    /// Marks the instructions that are the target of a jump. Sequences
+    /// spanning a target can't be fused, since the code could be entered
+    /// in the middle of them.
+    std::vector<bool> targets;
+
+    Instr& at(size_t idx)
+    {
+      return body->code[idx];
+    }
+
+    /// Returns true, if `idx` is a valid instruction that is only reached
+    /// from the previous one.
+    bool follows(size_t idx)
+    {
+      return idx < body->code.size() && !targets[idx];
+    }
+
+    void find_targets()
+    {
+      targets.assign(body->code.size() + 1, false);
+      for (auto& instr : body->code)
+      {
+        if (instr.op == Opcode::Jump || instr.op == Opcode::JumpFalse)
+        {
+          targets[instr.arg] = true;
+        }
+      }
+    }
+
+    /// Applies `rule` to every instruction and replaces the code with the
+    /// result. Jumps are updated to point to the rewritten instructions.
+    void apply(const Rule& rule)
+    {
+      find_targets();
+
+      auto& code = body->code;
+      auto& lines = body->lines;
+      std::vector<Instr> out;
+      out.reserve(code.size());
+      std::vector<uint32_t> out_lines;
+      std::vector<uint32_t> new_idx(code.size() + 1);
+
+      size_t idx = 0;
+      while (idx < code.size())
+      {
+        auto start = static_cast<uint32_t>(out.size());
+        size_t consumed = rule(idx, out);
+        if (consumed == 0)
+        {
+          out.push_back(code[idx]);
+          consumed = 1;
+        }
+
+        for (size_t i = idx; i < idx + consumed; i++)
+        {
+          new_idx[i] = start;
+        }
+        // The rewritten instructions belong to the line of the first one
+        if (!lines.empty())
+        {
+          out_lines.resize(out.size(), lines[idx]);
+        }
+        idx += consumed;
+      }
+      new_idx[code.size()] = static_cast<uint32_t>(out.size());
+
+      for (auto& instr : out)
+      {
+        if (instr.op == Opcode::Jump || instr.op == Opcode::JumpFalse)
+        {
+          instr.arg = new_idx[instr.arg];
+        }
+      }
+      code = std::move(out);
+      lines = std::move(out_lines);
+    }
+
+    /// The number of values `instr` pops from and pushes onto the stack.
+    /// Returns `std::nullopt` for instructions with an unknown stack effect
+    /// or control flow.
+    std::optional<std::pair<size_t, size_t>> stack_effect(Instr instr)
+    {
+      switch (instr.op)
+      {
+        case Opcode::LoadFrame:
+        case Opcode::LoadGlobal:
+        case Opcode::MoveFrame:
+        case Opcode::CreateDictionary:
+        case Opcode::CreateString:
+        case Opcode::CreateFunc:
+        case Opcode::Null:
+        case Opcode::Dup:
+          return {{0, 1}};
+        case Opcode::StoreFrame:
+          return {{1, 0}};
+        case Opcode::SwapFrame:
+        case Opcode::LoadFieldConst:
+        case Opcode::CreateKeyIter:
+        case Opcode::IterNext:
+          return {{1, 1}};
+        case Opcode::LoadField:
+        case Opcode::Eq:
+        case Opcode::Neq:
+          return {{2, 1}};
+        case Opcode::StoreFieldConst:
+          return {{2, 0}};
+        case Opcode::StoreField:
+          return {{3, 0}};
+        case Opcode::SwapField:
+          return {{3, 1}};
+        case Opcode::Print:
+          return {{0, 0}};
+        default:
+          return std::nullopt;
+      }
+    }
+
+    /// `Print` only produces output for the UI and the console log.
+    size_t strip_print(size_t idx, std::vector<Instr>&)
+    {
+      return at(idx).op == Opcode::Print ? 1 : 0;
+    }
+
+    size_t fuse(size_t idx, std::vector<Instr>& out)
+    {
+      auto instr = at(idx);
+      if (!follows(idx + 1))
+      {
+        return 0;
+      }
+      auto next = at(idx + 1);
+
+      // `CreateString k; LoadField` -> `LoadFieldConst k`
+      //
+      // The key is stored in the inline cache, this saves the allocation
+      // of the key string.
+      if (instr.op == Opcode::CreateString && next.op == Opcode::LoadField)
+      {
+        body->field_caches[next.arg].key =
+          rt::get_key_atom(body->strings[instr.arg]);
+        out.push_back({Opcode::LoadFieldConst, next.arg});
+        return 2;
+      }
+
+      // `Null; SwapFrame x` -> `MoveFrame x`
+      if (instr.op == Opcode::Null && next.op == Opcode::SwapFrame)
+      {
+        out.push_back({Opcode::MoveFrame, next.arg});
+        return 2;
+      }
+
+      // Values that are pushed and directly cleared again, don't have to be
+      // pushed at all. The same goes for clearing an empty stack.
+      if (
+        (instr.op == Opcode::Dup || instr.op == Opcode::Null ||
+         instr.op == Opcode::ClearStack) &&
+        next.op == Opcode::ClearStack)
+      {
+        return 1;
+      }
+
+      return 0;
+    }
+
+    /// `CreateString k; <value>; StoreField` -> `<value>; StoreFieldConst k`
+    ///
+    /// The instructions computing the value are checked to only use the
+    /// values they pushed themselves. This ensures that the string is the
+    /// key of the `StoreField`.
+    size_t fuse_store(size_t idx, std::vector<Instr>& out)
+    {
+      if (at(idx).op != Opcode::CreateString)
+      {
+        return 0;
+      }
+
+      size_t depth = 0;
+      for (size_t i = idx + 1; follows(i); i++)
+      {
+        auto instr = at(i);
+        if (instr.op == Opcode::StoreField && depth == 1)
+        {
+          out.insert(
+            out.end(), body->code.begin() + idx + 1, body->code.begin() + i);
+          auto key = rt::get_key_atom(body->strings[at(idx).arg]);
+          out.push_back({Opcode::StoreFieldConst, static_cast<uint32_t>(key)});
+          return i - idx + 1;
+        }
+
+        auto effect = stack_effect(instr);
+        if (!effect || effect->first > depth)
+        {
+          return 0;
+        }
+        if (instr.op == Opcode::Dup && instr.arg >= depth)
+        {
+          return 0;
+        }
+        depth = depth - effect->first + effect->second;
+      }
+
+      return 0;
+    }
+
+    /// Returns the index of the instruction that is executed after `idx`,
+    /// when unconditional jumps are followed.
+    size_t skip_jumps(size_t idx)
+    {
+      for (size_t i = 0; i < body->code.size() && at(idx).op == Opcode::Jump;
+           i++)
+      {
+        idx = at(idx).arg;
+      }
+      return idx;
+    }
+
+    /// Marks calls that are directly followed by a return as tail calls.
+    /// Either the result is returned, like in `return f(x)`:
+    ///
+    /// `Call; StoreFrame r; LoadFrame r; ReturnValue` or `Call; ReturnValue`
+    ///
+    /// or the result is discarded, like for a call statement at the end of
+    /// a function:
+    ///
+    /// `Call; ClearStack; Return`
+    ///
+    /// The remaining code is kept, it's used if the callee is a builtin.
+    size_t tail_call(size_t idx, std::vector<Instr>& out)
+    {
+      auto call = at(idx);
+      if (call.op != Opcode::Call)
+      {
+        return 0;
+      }
+
+      auto next = skip_jumps(idx + 1);
+      if (at(next).op == Opcode::StoreFrame)
+      {
+        auto load = skip_jumps(next + 1);
+        if (at(load).op == Opcode::LoadFrame && at(load).arg == at(next).arg)
+        {
+          next = skip_jumps(load + 1);
+        }
+      }
+
+      if (at(next).op == Opcode::ReturnValue)
+      {
+        out.push_back({Opcode::TailCall, call.arg});
+        return 1;
+      }
+
+      if (
+        at(next).op == Opcode::ClearStack &&
+        at(skip_jumps(next + 1)).op == Opcode::Return)
+      {
+        out.push_back({Opcode::TailCallDiscard, call.arg});
+        return 1;
+      }
+
+      return 0;
+    }
+
+  public:
+    Optimizer(Bytecode* body_) : body(body_) {}
+
+    void run(bool keep_print)
+    {
+      if (!keep_print)
+      {
+        apply([this](auto idx, auto& out) { return strip_print(idx, out); });
+      }
+      apply([this](auto idx, auto& out) { return fuse(idx, out); });
+      apply([this](auto idx, auto& out) { return fuse_store(idx, out); });
+      apply([this](auto idx, auto& out) { return tail_call(idx, out); });
+    }
+  };
+
+  void optimize(Bytecode* body, bool keep_print)
+  {
+    Optimizer(body).run(keep_print);
+    for (auto& func : body->funcs)
+    {
+      optimize(func.get(), keep_print);
+    }
+  }
+} // namespace verona::interpreter
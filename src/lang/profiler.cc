@@ -0,0 +1,102 @@
+#include "profiler.h"
+
+#include <algorithm>
+#include <iomanip>
+
+namespace verona::interpreter
+{
+  /// The names of the opcodes. Unlike `opcode_name`, these are unique.
+  static const char* const opcode_ids[] = {
+#define X(op, name) #op,
+    FRANKENSCRIPT_OPCODES(X)
+#undef X
+  };
+
+  struct Row
+  {
+    std::string name;
+    uint64_t count;
+    uint64_t ns;
+  };
+
+  template<typename T>
+  static std::vector<Row> sorted_rows(T& entries, auto name)
+  {
+    std::vector<Row> rows;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+      if (entries[i].count != 0)
+      {
+        rows.push_back({name(i), entries[i].count, entries[i].ns});
+      }
+    }
+    std::stable_sort(rows.begin(), rows.end(), [](auto& a, auto& b) {
+      return a.ns > b.ns;
+    });
+    return rows;
+  }
+
+  static void
+  write_rows(std::ostream& out, std::string title, std::vector<Row>& rows)
+  {
+    uint64_t total = 0;
+    for (auto& row : rows)
+    {
+      total += row.ns;
+    }
+
+    out << std::left << std::setw(20) << title << std::right << std::setw(12)
+        << "count" << std::setw(16) << "time (ns)" << std::setw(10) << "time %"
+        << std::setw(12) << "ns/op" << std::endl;
+    for (auto& row : rows)
+    {
+      auto percent = total ? 100.0 * row.ns / total : 0.0;
+      out << std::left << std::setw(20) << row.name << std::right
+          << std::setw(12) << row.count << std::setw(16) << row.ns
+          << std::setw(9) << std::fixed << std::setprecision(2) << percent
+          << "%" << std::setw(12) << std::setprecision(1)
+          << static_cast<double>(row.ns) / row.count << std::endl;
+    }
+    out << std::defaultfloat;
+  }
+
+  static void write_json_rows(
+    std::ostream& out, std::string key, std::string name_key, auto& rows)
+  {
+    out << "  \"" << key << "\": [";
+    for (size_t i = 0; i < rows.size(); i++)
+    {
+      out << (i ? ",\n" : "\n") << "    {\"" << name_key << "\": " << rows[i].name
+          << ", \"count\": " << rows[i].count << ", \"ns\": " << rows[i].ns
+          << "}";
+    }
+    out << "\n  ]";
+  }
+
+  void Profiler::write_table(std::ostream& out)
+  {
+    auto ops = sorted_rows(opcodes, [](auto i) { return opcode_ids[i]; });
+    write_rows(out, "opcode", ops);
+    out << std::endl;
+
+    auto line_rows = sorted_rows(lines, [](auto i) {
+      return i ? std::to_string(i) : std::string("unknown");
+    });
+    write_rows(out, "line", line_rows);
+  }
+
+  void Profiler::write_json(std::ostream& out)
+  {
+    auto ops = sorted_rows(opcodes, [](auto i) {
+      return "\"" + std::string(opcode_ids[i]) + "\"";
+    });
+    // Instructions without a line are reported as line 0
+    auto line_rows = sorted_rows(lines, [](auto i) { return std::to_string(i); });
+
+    out << "{\n";
+    write_json_rows(out, "opcodes", "opcode", ops);
+    out << ",\n";
+    write_json_rows(out, "lines", "line", line_rows);
+    out << "\n}\n";
+  }
+} // namespace verona::interpreter
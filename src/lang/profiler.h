@@ -0,0 +1,83 @@
+#pragma once
+
+#include "instr.h"
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace verona::interpreter
+{
+  /// Counts the executed instructions and the time spent on them, per opcode
+  /// and per source line. The time of an instruction is measured from its
+  /// dispatch until the dispatch of the next instruction. Calls therefore
+  /// only include the time to enter the function, not the time spent in it.
+  class Profiler
+  {
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry
+    {
+      uint64_t count{0};
+      uint64_t ns{0};
+    };
+
+    std::array<Entry, OpcodeCount> opcodes{};
+    /// Indexed by the line number
+    std::vector<Entry> lines;
+
+    Entry* last_opcode{nullptr};
+    Entry* last_line{nullptr};
+    Clock::time_point last_start;
+
+    void record_last(Clock::time_point now)
+    {
+      if (last_opcode)
+      {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    now - last_start)
+                    .count();
+        last_opcode->ns += ns;
+        last_line->ns += ns;
+      }
+    }
+
+  public:
+    /// Called when the instruction `ip` of `body` is dispatched.
+    void next(Bytecode* body, size_t ip)
+    {
+      auto now = Clock::now();
+      record_last(now);
+
+      uint32_t line = ip < body->lines.size() ? body->lines[ip] : 0;
+      if (line >= lines.size())
+      {
+        lines.resize(line + 1);
+      }
+
+      last_opcode = &opcodes[static_cast<size_t>(body->code[ip].op)];
+      last_line = &lines[line];
+      last_opcode->count++;
+      last_line->count++;
+      // Excludes the time of the profiler itself
+      last_start = Clock::now();
+    }
+
+    /// Attributes the time of the last instruction. This is called once the
+    /// program finished.
+    void stop()
+    {
+      record_last(Clock::now());
+      last_opcode = nullptr;
+      last_line = nullptr;
+    }
+
+    /// Writes the opcodes and lines sorted by their total time.
+    void write_table(std::ostream& out);
+
+    void write_json(std::ostream& out);
+  };
+} // namespace verona::interpreter
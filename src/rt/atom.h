@@ -0,0 +1,122 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace rt
+{
+  /// An interned field name. Every distinct name is mapped to a small
+  /// integer, this makes the comparison of field names an integer comparison.
+  ///
+  /// Atoms with the `StackBit` set don't refer to an interned name, but to the
+  /// entry of an operand stack. (See `stack_key`)
+  enum class Atom : uint32_t
+  {
+  };
+
+  /// Atoms that are known to the runtime. They are interned in this order,
+  /// when the atom table is created. The default constructed atom is the
+  /// empty name, which is used for edges that don't belong to a field.
+  namespace atoms
+  {
+    constexpr Atom Empty{0};
+    constexpr Atom Prototype{1};
+    constexpr Atom Parent{2};
+    constexpr Atom Value{3};
+  }
+
+  constexpr uint32_t StackBit{1u << 31};
+
+  class AtomTable
+  {
+    // A deque keeps the strings in place, the map can therefore use views of
+    // them as keys.
+    std::deque<std::string> names;
+    std::unordered_map<std::string_view, Atom> ids;
+    std::vector<std::string> stack_names;
+
+  public:
+    AtomTable()
+    {
+      intern("");
+      intern("__proto__");
+      intern("__parent__");
+      intern("value");
+    }
+
+    Atom intern(std::string_view name)
+    {
+      auto search = ids.find(name);
+      if (search != ids.end())
+      {
+        return search->second;
+      }
+
+      auto atom = Atom{static_cast<uint32_t>(names.size())};
+      auto& stored = names.emplace_back(name);
+      ids.emplace(stored, atom);
+      return atom;
+    }
+
+    const std::string& name(Atom atom)
+    {
+      auto idx = static_cast<uint32_t>(atom);
+      if ((idx & StackBit) == 0)
+      {
+        return names[idx];
+      }
+
+      idx &= ~StackBit;
+      while (idx >= stack_names.size())
+      {
+        std::stringstream ss;
+        ss << "_stack[" << stack_names.size() << "]";
+        stack_names.push_back(ss.str());
+      }
+      return stack_names[idx];
+    }
+  };
+
+  // TODO: Not concurrency safe
+  inline AtomTable* atom_table()
+  {
+    static AtomTable* table = new AtomTable();
+    return table;
+  }
+
+  /// Returns the atom of the given name, the name is added to the table if
+  /// it is new.
+  inline Atom intern(std::string_view name)
+  {
+    return atom_table()->intern(name);
+  }
+
+  inline const std::string& atom_name(Atom atom)
+  {
+    return atom_table()->name(atom);
+  }
+
+  /// The key used to refer to the entry at `idx` of an operand stack, for
+  /// instance in the Mermaid output.
+  inline Atom stack_key(size_t idx)
+  {
+    return Atom{static_cast<uint32_t>(idx) | StackBit};
+  }
+
+  /// Returns the stack index of the given key, if it refers to a stack entry.
+  inline std::optional<size_t> stack_index(Atom key)
+  {
+    auto value = static_cast<uint32_t>(key);
+    if ((value & StackBit) == 0)
+    {
+      return std::nullopt;
+    }
+    return value & ~StackBit;
+  }
+} // namespace rt
@@ -4,6 +4,8 @@
 #include "objects/region_object.h"
 #include "rt.h"
 
+#include <algorithm>
+#include <bit>
 #include <map>
 
 namespace rt::core
@@ -19,27 +21,40 @@ namespace rt::core
   class FrameObject : public objects::DynObject,
                       public verona::interpreter::FrameObj
   {
-    static constexpr std::string_view STACK_PREFIX = "_stack";
-    static inline thread_local std::vector<std::string> stack_keys;
-    size_t stack_size = 0;
-
-    FrameObject() : objects::DynObject(framePrototypeObject()) {}
-
-    std::string& stack_name(size_t idx)
+    /// The operand stack of this frame. Entries are owned references of the
+    /// frame, that are visited like fields with the key `stack_key(idx)`.
+    std::vector<objects::DynObject*> stack;
+    /// The entries of `stack`, whose references are not counted yet. Most
+    /// values are only on the stack during a single statement, this saves
+    /// their RC and LRC updates. Only the first 64 entries can be borrowed.
+    /// Locals are still counted, since a store moves the counted reference of
+    /// the stack into the frame and region checks read the frame's fields.
+    uint64_t borrowed{0};
+    static constexpr size_t MaxBorrowed{64};
+
+    /// Pops the top entry and returns whether it was counted
+    bool pop_entry()
     {
-      if (idx == stack_keys.size())
-      {
-        std::stringstream ss;
-        ss << STACK_PREFIX << "[" << idx << "]";
-        stack_keys.push_back(ss.str());
-      }
+      auto idx = stack.size() - 1;
+      stack.pop_back();
+      if (idx >= MaxBorrowed || !(borrowed >> idx & 1))
+        return true;
 
-      return stack_keys[idx];
+      borrowed &= ~(uint64_t{1} << idx);
+      return false;
     }
 
+    // Frames are not tracked in the registry, since one is created for
+    // every call. The objects referenced by frames are still tracked.
+    FrameObject()
+    : objects::DynObject(
+        Kind::Frame, framePrototypeObject(), objects::get_local_region(), false)
+    {}
+
   public:
     FrameObject(objects::DynObject* parent_frame)
-    : objects::DynObject(framePrototypeObject())
+    : objects::DynObject(
+        Kind::Frame, framePrototypeObject(), objects::get_local_region(), false)
     {
       if (parent_frame)
       {
@@ -62,33 +77,76 @@ namespace rt::core
     void stack_push(
       rt::objects::DynObject* value, const char* info, bool rc_add = true)
     {
-      auto old = this->set(stack_name(stack_size), value);
-      assert(old == nullptr && "the stack already had a value");
-      stack_size += 1;
+      stack.push_back(value);
 
-      std::cout << "pushed " << value << " (" << info << ")" << std::endl;
+      RT_LOG(Stack, Trace, "pushed " << value << " (" << info << ")");
       if (rc_add)
       {
         rt::add_reference(this, value);
       }
     }
 
+    void stack_push_borrowed(rt::objects::DynObject* value, const char* info)
+    {
+      if (stack.size() >= MaxBorrowed)
+      {
+        stack_push(value, info);
+        return;
+      }
+
+      borrowed |= uint64_t{1} << stack.size();
+      stack.push_back(value);
+      RT_LOG(Stack, Trace, "pushed " << value << " (" << info << ", borrowed)");
+    }
+
     rt::objects::DynObject* stack_pop(char const* info)
     {
-      stack_size -= 1;
-      auto value = erase(stack_name(stack_size));
-      std::cout << "poped " << value << " (" << value << ")" << std::endl;
+      bool counted;
+      auto value = stack_pop(info, counted);
+      if (!counted)
+      {
+        rt::add_reference(this, value);
+      }
+      return value;
+    }
+
+    rt::objects::DynObject* stack_pop(char const* info, bool& counted)
+    {
+      if (stack.empty())
+      {
+        ui::error("Interpreter: The stack is too small");
+      }
+
+      auto value = stack.back();
+      counted = pop_entry();
+      RT_LOG(Stack, Trace, "poped " << value << " (" << info << ")");
       return value;
     }
 
+    void stack_reconcile()
+    {
+      while (borrowed)
+      {
+        auto idx = std::countr_zero(borrowed);
+        borrowed &= borrowed - 1;
+        rt::add_reference(this, stack[idx]);
+      }
+    }
+
     size_t get_stack_size()
     {
-      return stack_size;
+      return stack.size();
     }
 
     rt::objects::DynObject* stack_get(size_t index)
     {
-      return get(stack_name(index)).value();
+      return stack[index];
+    }
+
+  protected:
+    std::vector<objects::DynObject*>* frame_stack() override
+    {
+      return &stack;
     }
   };
 
@@ -115,25 +173,21 @@ namespace rt::core
   class FuncObject : public objects::DynObject
   {
   public:
-    FuncObject(objects::DynObject* prototype_) : objects::DynObject(prototype_)
+    FuncObject(Kind kind_, objects::DynObject* prototype_)
+    : objects::DynObject(kind_, prototype_, objects::get_local_region())
     {}
   };
 
   class BytecodeFuncObject : public FuncObject
   {
+    // The body is owned by the enclosing bytecode and outlives this object
     verona::interpreter::Bytecode* body;
 
   public:
     BytecodeFuncObject(verona::interpreter::Bytecode* body_)
-    : FuncObject(bytecodeFuncPrototypeObject()), body(body_)
+    : FuncObject(Kind::Func, bytecodeFuncPrototypeObject()), body(body_)
     {}
 
-    ~BytecodeFuncObject()
-    {
-      verona::interpreter::delete_bytecode(this->body);
-      this->body = nullptr;
-    }
-
     verona::interpreter::Bytecode* get_bytecode()
     {
       return this->body;
@@ -146,7 +200,7 @@ namespace rt::core
 
   public:
     BuiltinFuncObject(BuiltinFuncPtr func_)
-    : FuncObject(builtinFuncPrototypeObject()), func(func_)
+    : FuncObject(Kind::Builtin, builtinFuncPrototypeObject()), func(func_)
     {}
 
     BuiltinFuncPtr get_func()
@@ -164,12 +218,14 @@ namespace rt::core
   class StringObject : public objects::DynObject
   {
     std::string value;
+    std::optional<Atom> atom;
 
   public:
     StringObject(
       std::string value_,
       objects::Region* region = rt::objects::get_local_region())
-    : objects::DynObject(stringPrototypeObject(), region), value(value_)
+    : objects::DynObject(Kind::String, stringPrototypeObject(), region),
+      value(value_)
     {}
 
     std::string get_name() override
@@ -184,9 +240,15 @@ namespace rt::core
       return value;
     }
 
-    objects::DynObject* is_primitive() override
+    /// The atom of this string. Strings are immutable, the atom is therefore
+    /// only looked up once.
+    Atom as_atom()
     {
-      return this;
+      if (!atom)
+      {
+        atom = intern(value);
+      }
+      return atom.value();
     }
   };
 
@@ -204,6 +266,17 @@ namespace rt::core
     return val;
   }
 
+  /// The string objects of string literals, see `rt::get_str_constant`.
+  /// Like `trueObject()`, they are immutable and live for the entire
+  /// execution.
+  // TODO: Not concurrency safe
+  inline std::map<std::string, StringObject*, std::less<>>* string_constants()
+  {
+    static std::map<std::string, StringObject*, std::less<>>* constants =
+      new std::map<std::string, StringObject*, std::less<>>();
+    return constants;
+  }
+
   // The prototype object for iterators
   inline PrototypeObject* keyIterPrototypeObject()
   {
@@ -213,23 +286,34 @@ namespace rt::core
 
   class KeyIterObject : public objects::DynObject
   {
-    std::map<std::string, objects::DynObject*>::iterator iter;
-    std::map<std::string, objects::DynObject*>::iterator iter_end;
+    // The keys are copied, the iterator therefore stays valid, when the
+    // source object is modified or deallocated.
+    std::vector<Atom> keys;
+    size_t next{0};
 
   public:
-    KeyIterObject(std::map<std::string, objects::DynObject*>& fields)
-    : objects::DynObject(keyIterPrototypeObject()),
-      iter(fields.begin()),
-      iter_end(fields.end())
-    {}
+    KeyIterObject(objects::Fields& fields)
+    : objects::DynObject(
+        Kind::Iter, keyIterPrototypeObject(), objects::get_local_region())
+    {
+      keys.reserve(fields.size());
+      for (auto [key, value] : fields)
+      {
+        keys.push_back(key);
+      }
+      // Atoms are numbered in interning order, keys are iterated by name
+      std::sort(keys.begin(), keys.end(), [](Atom a, Atom b) {
+        return atom_name(a) < atom_name(b);
+      });
+    }
 
     objects::DynObject* iter_next()
     {
       objects::DynObject* obj = nullptr;
-      if (this->iter != this->iter_end)
+      if (next < keys.size())
       {
-        obj = make_str(this->iter->first);
-        this->iter++;
+        obj = make_str(atom_name(keys[next]));
+        next++;
       }
 
       return obj;
@@ -239,11 +323,6 @@ namespace rt::core
     {
       return "<iterator>";
     }
-
-    objects::DynObject* is_primitive() override
-    {
-      return this;
-    }
   };
 
   // The prototype object for cown
@@ -279,17 +358,30 @@ namespace rt::core
     }
 
     Status status;
+    /// The region owned by this cown, if the value is a bridge object.
+    objects::Region* owned_region{nullptr};
 
   public:
     CownObject(objects::DynObject* obj)
-    : objects::DynObject(cownPrototypeObject(), objects::cown_region)
+    : objects::DynObject(
+        Kind::Cown, cownPrototypeObject(), objects::cown_region)
     {
       status = Status::Pending;
-      auto old = set("value", obj);
+      auto old = set(atoms::Value, obj);
       assert(!old);
     }
 
-    [[nodiscard]] DynObject* set(std::string name, DynObject* obj) override
+    ~CownObject()
+    {
+      // The value might already be deallocated, but the region is only
+      // collected later. It should no longer notify this cown.
+      if (owned_region && owned_region->cown == this)
+      {
+        owned_region->cown = nullptr;
+      }
+    }
+
+    [[nodiscard]] DynObject* set_cown_value(Atom name, DynObject* obj) override
     {
       assert_modifiable();
 
@@ -312,20 +404,25 @@ namespace rt::core
           ss << "A cown can only be created from a free region" << std::endl;
           ss << "| " << obj << " is currently a subregion of "
              << region->parent->bridge;
-          ui::error(ss.str(), {this, "", obj});
+          ui::error(ss.str(), {this, {}, obj});
         }
 
         region->cown = this;
       }
 
-      DynObject* old = fields[name];
-      fields[name] = obj;
+      DynObject* old = fields.set(name, obj);
 
       if (old && !old->is_immutable() && !old->is_cown())
       {
         auto old_reg = objects::get_region(old);
         assert(old_reg->cown == this);
         old_reg->cown = nullptr;
+        owned_region = nullptr;
+      }
+
+      if (obj && !obj->is_immutable() && !obj->is_cown())
+      {
+        owned_region = objects::get_region(obj);
       }
 
       update_status();
@@ -341,12 +438,7 @@ namespace rt::core
       return ss.str();
     }
 
-    objects::DynObject* is_primitive() override
-    {
-      return this;
-    }
-
-    bool is_opaque() override
+    bool is_cown_opaque() override
     {
       switch (status)
       {
@@ -375,7 +467,7 @@ namespace rt::core
         return;
       }
 
-      auto value = this->get("value").value();
+      auto value = this->get(atoms::Value).value();
       if (!value || value->is_immutable() || value->is_cown())
       {
         status = Status::Released;
@@ -408,12 +500,12 @@ namespace rt::core
     return globals;
   }
 
-  inline std::map<std::string, objects::DynObject*>* global_names()
+  inline std::map<Atom, objects::DynObject*>* global_names()
   {
-    static std::map<std::string, objects::DynObject*>* global_names =
-      new std::map<std::string, objects::DynObject*>{
-        {"True", trueObject()},
-        {"False", falseObject()},
+    static std::map<Atom, objects::DynObject*>* global_names =
+      new std::map<Atom, objects::DynObject*>{
+        {intern("True"), trueObject()},
+        {intern("False"), falseObject()},
       };
     return global_names;
   }
@@ -7,6 +7,32 @@ namespace rt::core
   {
     if (!ui->is_mermaid())
     {
+      // The diagram builtins have no effect without a diagram. They are still
+      // defined, so the same programs can run with every UI.
+      for (auto name :
+           {"mermaid_hide",
+            "mermaid_show",
+            "mermaid_show_all",
+            "mermaid_show_tainted",
+            "mermaid_taint",
+            "mermaid_untaint",
+            "mermaid_show_cown_region",
+            "mermaid_hide_cown_region",
+            "mermaid_show_immutable_region",
+            "mermaid_hide_immutable_region",
+            "mermaid_show_functions",
+            "mermaid_hide_functions",
+            "breakpoint"})
+      {
+        add_builtin(name, [](auto frame, auto args) {
+          for (size_t i = 0; i < args; i++)
+          {
+            auto value = frame->stack_pop("ignored argument");
+            rt::remove_reference(frame->object(), value);
+          }
+          return std::nullopt;
+        });
+      }
       return;
     }
     auto mermaid = reinterpret_cast<ui::MermaidUI*>(ui);
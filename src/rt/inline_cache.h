@@ -0,0 +1,57 @@
+#pragma once
+
+#include "atom.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace rt::objects
+{
+  class DynObject;
+  class Shape;
+} // namespace rt::objects
+
+namespace rt
+{
+  /// An inline cache for the field lookups of a single instruction.
+  ///
+  /// The cache remembers where `key` was found for receivers of one shape.
+  /// Lookups that reach the prototype chain are additionally keyed on the
+  /// prototype of the receiver and are only valid as long as the global
+  /// prototype version is unchanged. Lookups through a frozen prototype
+  /// chain use the version of the frozen prototypes instead, which only
+  /// changes when one is deallocated. (See `DynObject::get`)
+  struct FieldCache
+  {
+    enum class Kind : uint8_t
+    {
+      Empty,
+      /// The key is a field of the receiver, stored in `slot`
+      Own,
+      /// The key is stored in `slot` of `holder` in the prototype chain
+      Prototype,
+      /// The key is neither defined on the receiver nor its prototypes
+      Missing,
+    };
+
+    Kind kind{Kind::Empty};
+    Atom key{};
+    objects::Shape* shape{nullptr};
+    objects::DynObject* prototype{nullptr};
+    /// Indicates that `version` is the version of the frozen prototypes
+    bool frozen{false};
+    size_t version{0};
+    objects::DynObject* holder{nullptr};
+    size_t slot{0};
+  };
+
+  /// The inline cache of a `LoadGlobal` instruction. It caches the lookups
+  /// in the local and global frame, as well as the builtin with the name.
+  struct GlobalCache
+  {
+    Atom name;
+    FieldCache local{};
+    FieldCache global{};
+    objects::DynObject* builtin{nullptr};
+  };
+} // namespace rt
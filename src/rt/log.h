@@ -0,0 +1,128 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <iostream>
+#include <optional>
+#include <string_view>
+
+namespace rt::log
+{
+  /// The categories of the runtime output. The level can be set for each
+  /// category individually.
+  enum class Category : uint8_t
+  {
+    /// Reference count changes
+    Rc,
+    /// Allocation and deallocation of objects
+    Alloc,
+    /// Pushes and pops of the frame stacks
+    Stack,
+    /// Region tracking, LRC updates and region collection
+    Region,
+    /// Executed instructions and the progress of the program
+    Interp,
+  };
+  constexpr size_t CategoryCount{5};
+
+  enum class Level : uint8_t
+  {
+    None,
+    /// Progress messages, like the start and the end of the program
+    Info,
+    /// Messages for every single operation
+    Trace,
+  };
+
+  // TODO: Not concurrency safe
+  inline std::array<Level, CategoryCount> levels{
+    Level::Trace, Level::Trace, Level::Trace, Level::Trace, Level::Trace};
+
+  inline bool enabled(Category category, Level level)
+  {
+    return levels[static_cast<size_t>(category)] >= level;
+  }
+
+  inline void set_level(Category category, Level level)
+  {
+    levels[static_cast<size_t>(category)] = level;
+  }
+
+  inline void set_level(Level level)
+  {
+    levels.fill(level);
+  }
+
+  inline std::optional<Category> parse_category(std::string_view name)
+  {
+    if (name == "rc")
+      return Category::Rc;
+    if (name == "alloc")
+      return Category::Alloc;
+    if (name == "stack")
+      return Category::Stack;
+    if (name == "region")
+      return Category::Region;
+    if (name == "interp")
+      return Category::Interp;
+    return std::nullopt;
+  }
+
+  inline std::optional<Level> parse_level(std::string_view name)
+  {
+    if (name == "none")
+      return Level::None;
+    if (name == "info")
+      return Level::Info;
+    if (name == "trace")
+      return Level::Trace;
+    return std::nullopt;
+  }
+
+  /// Parses a `<category>=<level>` setting and applies it. Returns false, if
+  /// the setting is invalid.
+  inline bool apply_setting(std::string_view setting)
+  {
+    auto split = setting.find('=');
+    if (split == std::string_view::npos)
+      return false;
+
+    auto category = parse_category(setting.substr(0, split));
+    auto level = parse_level(setting.substr(split + 1));
+    if (!category || !level)
+      return false;
+
+    set_level(category.value(), level.value());
+    return true;
+  }
+} // namespace rt::log
+
+/// Writes the streamed `message` to the console, if the level of the
+/// category is enabled. The message is only evaluated if it's printed.
+///
+/// ```
+/// RT_LOG(Rc, Trace, "Change RC: " << obj << " + " << delta);
+/// ```
+///
+/// Defining `FRANKENSCRIPT_NO_LOGGING` removes all log statements. The message
+/// is still type checked, but the code is removed by the compiler.
+#ifdef FRANKENSCRIPT_NO_LOGGING
+#  define RT_LOG(category, level, message) \
+    do \
+    { \
+      if constexpr (false) \
+      { \
+        std::cout << message << '\n'; \
+      } \
+    } while (0)
+#else
+#  define RT_LOG(category, level, message) \
+    do \
+    { \
+      if (::rt::log::enabled( \
+            ::rt::log::Category::category, ::rt::log::Level::level)) \
+      { \
+        std::cout << message << '\n'; \
+      } \
+    } while (0)
+#endif
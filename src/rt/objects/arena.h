@@ -0,0 +1,214 @@
+#pragma once
+
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace rt::objects
+{
+  /// Allocates the memory of objects.
+  ///
+  /// Objects are carved out of aligned pages, every page holds objects of one
+  /// size class. A page keeps a free list of its freed objects and counts the
+  /// live ones. Once the last object of a page is freed, the page is reset
+  /// and hands out its memory in address order again. Tearing down a region
+  /// therefore returns whole pages, without scattering the next allocations
+  /// over the freed memory. Every size class keeps one empty page as a
+  /// spare, further empty pages are returned to the system allocator.
+  ///
+  /// The memory is not owned by regions, since objects are allocated in the
+  /// local region and keep their address, when they are moved into a region.
+  class Arena
+  {
+    static constexpr size_t Granularity{16};
+    /// Larger objects are allocated with `::operator new`
+    static constexpr size_t MaxSize{512};
+    static constexpr size_t PageSize{64 * 1024};
+    static constexpr size_t SizeClasses{MaxSize / Granularity};
+
+    struct FreeObject
+    {
+      FreeObject* next;
+    };
+
+    struct alignas(Granularity) Page
+    {
+      /// The neighbours in the list of pages of the size class, with free
+      /// memory
+      Page* next_available{nullptr};
+      Page* prev_available{nullptr};
+      bool is_available{false};
+      size_t live{0};
+      FreeObject* free{nullptr};
+      /// The memory after the last object, that was ever allocated
+      char* bump;
+
+      Page() : bump(memory()) {}
+
+      char* memory()
+      {
+        return reinterpret_cast<char*>(this) + sizeof(Page);
+      }
+
+      char* end()
+      {
+        return reinterpret_cast<char*>(this) + PageSize;
+      }
+
+      void reset()
+      {
+        free = nullptr;
+        bump = memory();
+      }
+    };
+
+    /// The page that is currently allocated from, per size class
+    std::array<Page*, SizeClasses> current{};
+    /// Other pages with free memory, per size class
+    std::array<Page*, SizeClasses> available{};
+    /// An empty page, per size class
+    std::array<Page*, SizeClasses> spare{};
+
+    static size_t size_class(size_t size)
+    {
+      return (size + Granularity - 1) / Granularity - 1;
+    }
+
+    static Page* page_of(void* mem)
+    {
+      return reinterpret_cast<Page*>(
+        reinterpret_cast<uintptr_t>(mem) & ~(PageSize - 1));
+    }
+
+    void link_available(Page* page, size_t sc)
+    {
+      page->is_available = true;
+      page->prev_available = nullptr;
+      page->next_available = available[sc];
+      if (available[sc])
+        available[sc]->prev_available = page;
+      available[sc] = page;
+    }
+
+    void unlink_available(Page* page, size_t sc)
+    {
+      if (page->prev_available)
+        page->prev_available->next_available = page->next_available;
+      else
+        available[sc] = page->next_available;
+      if (page->next_available)
+        page->next_available->prev_available = page->prev_available;
+      page->is_available = false;
+    }
+
+    Page* next_page(size_t sc)
+    {
+      if (auto page = available[sc])
+      {
+        unlink_available(page, sc);
+        return page;
+      }
+
+      if (auto page = spare[sc])
+      {
+        spare[sc] = nullptr;
+        return page;
+      }
+
+      auto mem = ::operator new(PageSize, std::align_val_t{PageSize});
+      return new (mem) Page();
+    }
+
+    /// Keeps the empty `page` as the spare of its size class or frees it
+    void release(Page* page, size_t sc)
+    {
+      if (page->is_available)
+        unlink_available(page, sc);
+
+      if (!spare[sc])
+      {
+        page->reset();
+        spare[sc] = page;
+        return;
+      }
+
+      page->~Page();
+      ::operator delete(page, std::align_val_t{PageSize});
+    }
+
+  public:
+    // TODO: Not concurrency safe
+    static Arena* get()
+    {
+      static Arena* arena = new Arena();
+      return arena;
+    }
+
+    void* allocate(size_t size)
+    {
+      if (size == 0 || size > MaxSize)
+      {
+        return ::operator new(size);
+      }
+
+      auto sc = size_class(size);
+      auto rounded = (sc + 1) * Granularity;
+      auto page = current[sc];
+      if (
+        !page ||
+        (!page->free &&
+         static_cast<size_t>(page->end() - page->bump) < rounded))
+      {
+        page = current[sc] = next_page(sc);
+      }
+
+      page->live++;
+      if (auto obj = page->free)
+      {
+        page->free = obj->next;
+        return obj;
+      }
+
+      auto mem = page->bump;
+      page->bump += rounded;
+      return mem;
+    }
+
+    void deallocate(void* mem, size_t size)
+    {
+      if (size == 0 || size > MaxSize)
+      {
+        ::operator delete(mem);
+        return;
+      }
+
+      auto sc = size_class(size);
+      auto page = page_of(mem);
+      assert(page->live != 0);
+      page->live--;
+      if (page->live == 0)
+      {
+        if (page == current[sc])
+        {
+          page->reset();
+        }
+        else
+        {
+          release(page, sc);
+        }
+        return;
+      }
+
+      auto obj = static_cast<FreeObject*>(mem);
+      obj->next = page->free;
+      page->free = obj;
+
+      if (page != current[sc] && !page->is_available)
+      {
+        link_available(page, sc);
+      }
+    }
+  };
+} // namespace rt::objects
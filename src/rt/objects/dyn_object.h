@@ -1,11 +1,15 @@
 #pragma once
 
 #include "../../lang/interpreter.h"
+#include "../log.h"
 #include "../rt.h"
+#include "arena.h"
 #include "region.h"
+#include "shape.h"
 #include "visit.h"
 
 #include <atomic>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
 #include <iterator>
@@ -13,6 +17,7 @@
 #include <set>
 #include <sstream>
 #include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -24,8 +29,8 @@ namespace rt::core
 namespace rt::objects
 {
   constexpr uintptr_t ImmutableTag{1};
-  const std::string PrototypeField{"__proto__"};
-  const std::string ParentField{"__parent__"};
+  constexpr Atom PrototypeField{atoms::Prototype};
+  constexpr Atom ParentField{atoms::Parent};
 
   Region* get_region(DynObject* obj);
 
@@ -49,28 +54,134 @@ namespace rt::objects
     friend void merge_regions(DynObject* src, DynObject* sink);
     friend void move_objects(Region* src, Region* sink);
 
+  public:
+    /// The type of an object. It is stored in the header, type checks
+    /// therefore don't need a virtual call.
+    enum class Kind : uint8_t
+    {
+      Plain,
+      Frame,
+      String,
+      /// A `BytecodeFuncObject`
+      Func,
+      /// A `BuiltinFuncObject`
+      Builtin,
+      Iter,
+      Cown,
+      /// The bridge object of a region
+      Region,
+      Prototype,
+    };
+
+  private:
+    friend class ObjectList;
+
+    /// The number of tracked objects, counted per thread. An object that is
+    /// freed by another thread makes both counts wrap around, only their sum
+    /// is meaningful.
+    inline static thread_local size_t count{0};
+    /// All tracked objects, if the registry is enabled. An object stores its
+    /// index, it is removed by moving the last entry into its slot.
     // TODO: Not concurrency safe
-    inline static size_t count{0};
+    inline static std::vector<DynObject*> registry{};
+    inline static bool use_registry{true};
+
+    /// `registry_index` of objects that are not tracked
+    static constexpr uint32_t Untracked{UINT32_MAX};
+    /// `registry_index` of tracked objects, that are not in the registry
+    static constexpr uint32_t Unlisted{UINT32_MAX - 1};
+    /// This version is incremented whenever the prototype chain of any
+    /// object might have changed. It invalidates cached prototype lookups.
     // TODO: Not concurrency safe
-    inline static std::set<DynObject*> all_objects{};
+    inline static size_t prototype_version{0};
+    /// This version is incremented when a frozen prototype is deallocated.
+    /// A frozen prototype chain can't change otherwise, lookups through it
+    /// only depend on this version.
+    // TODO: Not concurrency safe
+    inline static size_t frozen_prototype_version{0};
 
-    size_t rc{1};
+    /// The result of a lookup in a prototype chain.
+    struct ChainLookup
+    {
+      /// The object that stores the key, or `nullptr` if it is missing
+      DynObject* holder{nullptr};
+      size_t slot{0};
+      /// Indicates that all searched objects are immutable
+      bool frozen{false};
+      /// The version of the lookup, the initial value is never valid
+      size_t version{SIZE_MAX};
+
+      bool is_valid()
+      {
+        return version ==
+          (frozen ? frozen_prototype_version : prototype_version);
+      }
+    };
+    /// The cached lookups in the prototype chain, per prototype. The entries
+    /// of a prototype are removed when it is deallocated.
+    // TODO: Not concurrency safe
+    inline static std::unordered_map<
+      DynObject*,
+      std::unordered_map<Atom, ChainLookup>>
+      chain_lookups{};
+
+    /// The tag of `region` holds the kind of the object in the low bits
+    static constexpr uintptr_t KindMask{0xF};
+    static_assert(static_cast<uintptr_t>(Kind::Prototype) <= KindMask);
+    /// The tag of `region` of objects, that are, or were, the prototype of
+    /// an object. Adding or removing keys of such objects changes
+    /// `prototype_version`.
+    static constexpr uintptr_t PrototypeTag{0x10};
+
+    // The header is packed, the RC and the registry index share a word and
+    // the kind and `PrototypeTag` are stored in the region pointer.
+    uint32_t rc{1};
+    uint32_t registry_index{Untracked};
     RegionPointer region{nullptr};
+    /// The links of the `ObjectList` of the region
+    DynObject* region_prev{nullptr};
+    DynObject* region_next{nullptr};
     DynObject* prototype{nullptr};
 
-    std::map<std::string, DynObject*> fields{};
+    Fields fields{};
+
+    void register_object()
+    {
+      count++;
+      if (!use_registry)
+      {
+        registry_index = Unlisted;
+        return;
+      }
+
+      assert(registry.size() < Unlisted);
+      registry_index = static_cast<uint32_t>(registry.size());
+      registry.push_back(this);
+    }
+
+    void unregister_object()
+    {
+      count--;
+      if (registry_index == Unlisted)
+        return;
+
+      auto last = registry.back();
+      registry[registry_index] = last;
+      last->registry_index = registry_index;
+      registry.pop_back();
+    }
 
   public:
     size_t change_rc(signed delta)
     {
-      std::cout << "Change RC: " << get_name() << " " << rc << " + " << delta
-                << std::endl;
+      RT_LOG(
+        Rc, Trace, "Change RC: " << get_name() << " " << rc << " + " << delta);
       if (!(is_immutable() || is_cown()))
       {
         assert(delta == 0 || rc != 0);
         rc += delta;
         // Check not underflowing.
-        assert(rc >> 62 == 0);
+        assert(rc >> 31 == 0);
         return rc;
       }
 
@@ -81,36 +192,88 @@ namespace rt::objects
     }
 
     // prototype is borrowed, the caller does not need to provide an RC.
+    //
+    // Objects that are not `tracked` are excluded from the registry and the
+    // leak detection. They still take part in the region and RC tracking.
     DynObject(
       DynObject* prototype_ = nullptr,
-      Region* containing_region = get_local_region())
+      Region* containing_region = get_local_region(),
+      bool tracked = true)
+    : DynObject(Kind::Plain, prototype_, containing_region, tracked)
+    {}
+
+  protected:
+    DynObject(
+      Kind kind_,
+      DynObject* prototype_,
+      Region* containing_region,
+      bool tracked = true)
     : prototype(prototype_)
     {
       assert(containing_region != nullptr);
-      count++;
-      all_objects.insert(this);
-      region = containing_region;
-      containing_region->objects.insert(this);
+      if (tracked)
+      {
+        register_object();
+      }
+      region = {containing_region, static_cast<uintptr_t>(kind_)};
+      if (containing_region != immutable_region)
+        containing_region->objects.insert(this);
 
       if (prototype != nullptr)
       {
         // prototype->change_rc(1);
         objects::add_reference(this, prototype);
+        prototype->mark_used_as_prototype();
       }
-      std::cout << "Allocate: " << this << std::endl;
+      RT_LOG(Alloc, Trace, "Allocate: " << this);
+    }
+
+    /// Replaces the value of a cown, see `set`
+    [[nodiscard]] virtual DynObject* set_cown_value(Atom, DynObject*)
+    {
+      assert(false);
+      return nullptr;
+    }
+
+    /// Indicates that a cown is not acquired, see `is_opaque`
+    virtual bool is_cown_opaque()
+    {
+      assert(false);
+      return false;
+    }
+
+    /// The operand stack of a frame, see `get_stack`
+    virtual std::vector<DynObject*>* frame_stack()
+    {
+      assert(false);
+      return nullptr;
+    }
+
+  public:
+    // Objects of all types are allocated in the arena. The size of `delete`
+    // is the one of the dynamic type, due to the virtual destructor.
+    static void* operator new(size_t size)
+    {
+      return Arena::get()->allocate(size);
+    }
+
+    static void operator delete(void* mem, size_t size)
+    {
+      Arena::get()->deallocate(mem, size);
     }
 
     // TODO This should use prototype lookup for the destructor.
     virtual ~DynObject()
     {
-      // Erase from set of all objects, and remove count if found.
-      auto matched = all_objects.erase(this);
-      count -= matched;
+      // Untracked objects are special objects, that we don't track for
+      // leaks, otherwise, we need to check if the RC is zero.
+      auto tracked = registry_index != Untracked;
+      if (tracked)
+      {
+        unregister_object();
+      }
 
-      // If it wasn't in the all_objects set, then it was a special object
-      // that we don't track for leaks, otherwise, we need to check if the
-      // RC is zero.
-      if (change_rc(0) != 0 && matched != 0)
+      if (change_rc(0) != 0 && tracked)
       {
         std::stringstream stream;
         stream << this;
@@ -122,7 +285,16 @@ namespace rt::objects
       if (!is_immutable() && r != nullptr)
         r->objects.erase(this);
 
-      std::cout << "Deallocate: " << get_name() << std::endl;
+      // The address might be reused by a new prototype
+      if (is_used_as_prototype())
+      {
+        prototype_version++;
+        if (is_immutable())
+          frozen_prototype_version++;
+        chain_lookups.erase(this);
+      }
+
+      RT_LOG(Alloc, Trace, "Deallocate: " << get_name());
     }
 
     size_t get_rc()
@@ -139,15 +311,46 @@ namespace rt::objects
       return stream.str();
     }
 
-    /// TODO remove virtual once we have primitive functions.
-    virtual DynObject* is_primitive()
+    Kind get_kind()
     {
-      return nullptr;
+      return static_cast<Kind>(region.get_tag() & KindMask);
     }
 
-    virtual bool is_opaque()
+    bool is_used_as_prototype()
     {
-      return false;
+      return region.get_tag() & PrototypeTag;
+    }
+
+    void mark_used_as_prototype()
+    {
+      region.add_tag(PrototypeTag);
+    }
+
+    DynObject* is_primitive()
+    {
+      switch (get_kind())
+      {
+        case Kind::String:
+        case Kind::Iter:
+        case Kind::Cown:
+          return this;
+        default:
+          return nullptr;
+      }
+    }
+
+    /// Only cowns, that are not acquired, are opaque.
+    bool is_opaque()
+    {
+      return get_kind() == Kind::Cown && is_cown_opaque();
+    }
+
+    /// The operand stack of this object, if it has one. Stack entries are
+    /// references, just like fields. The object is responsible for the
+    /// storage, but references are visited and destructed like fields.
+    std::vector<DynObject*>* get_stack()
+    {
+      return get_kind() == Kind::Frame ? frame_stack() : nullptr;
     }
 
     bool is_cown()
@@ -178,14 +381,13 @@ namespace rt::objects
         if (r->bridge == obj)
         {
           r->bridge = nullptr;
-          auto old_proto = obj->set_prototype(nullptr);
+          auto old_proto = obj->clear_region_prototype();
           rt::remove_reference(this, old_proto);
           dead_regions.push_back(r);
         }
 
         // Make obj immutable
         obj->region.set_ptr(immutable_region);
-        immutable_region->objects.insert(obj);
 
         return true;
       });
@@ -203,46 +405,158 @@ namespace rt::objects
       return region.get_ptr() == immutable_region;
     }
 
-    [[nodiscard]] std::optional<DynObject*> get(std::string name)
+    [[nodiscard]] std::optional<DynObject*> get(Atom name)
     {
-      auto result = fields.find(name);
-      if (result != fields.end())
-        return result->second;
+      if (auto value = fields.find(name))
+        return *value;
 
       if (name == PrototypeField)
         return prototype;
 
       // Search the prototype chain.
-      // TODO make this iterative.
       if (prototype != nullptr)
-        return prototype->get(name);
+      {
+        auto found = prototype->lookup_chain(name);
+        if (found.holder != nullptr)
+          return found.holder->fields.value(found.slot);
+      }
 
       // No field or prototype chain found.
       return std::nullopt;
     }
 
+    /// Searches `name` in the fields of this prototype and its prototype
+    /// chain. Lookups that go past this object are cached on it, they stay
+    /// valid until the global prototype version changes or, if the searched
+    /// objects are all frozen, until a frozen prototype is deallocated.
+    ChainLookup lookup_chain(Atom name)
+    {
+      assert(is_used_as_prototype());
+      if (auto slot = fields.lookup(name))
+        return {this, slot.value(), is_immutable(), 0};
+
+      if (prototype == nullptr)
+        return {};
+
+      auto& entry = chain_lookups[this][name];
+      if (entry.is_valid())
+        return entry;
+
+      entry = {};
+      entry.frozen = is_immutable();
+      for (auto obj = prototype; obj != nullptr; obj = obj->prototype)
+      {
+        entry.frozen &= obj->is_immutable();
+        if (auto slot = obj->fields.lookup(name))
+        {
+          entry.holder = obj;
+          entry.slot = slot.value();
+          break;
+        }
+      }
+      entry.version =
+        entry.frozen ? frozen_prototype_version : prototype_version;
+      return entry;
+    }
+
+    /// Looks up `name` like `get`, using the inline cache of the calling
+    /// instruction. On a hit, this skips the search of the fields and the
+    /// prototype chain. Objects in dictionary mode and the prototype field
+    /// are not cached.
+    [[nodiscard]] std::optional<DynObject*> get(Atom name, FieldCache& cache)
+    {
+      auto shape = fields.get_shape();
+      if (shape != nullptr && shape == cache.shape && name == cache.key)
+      {
+        bool chain_valid = prototype == cache.prototype &&
+          cache.version ==
+            (cache.frozen ? frozen_prototype_version : prototype_version);
+        switch (cache.kind)
+        {
+          case FieldCache::Kind::Own:
+            return fields.value(cache.slot);
+          case FieldCache::Kind::Prototype:
+            if (chain_valid)
+              return cache.holder->fields.value(cache.slot);
+            break;
+          case FieldCache::Kind::Missing:
+            if (chain_valid)
+              return std::nullopt;
+            break;
+          default:
+            break;
+        }
+      }
+
+      if (shape == nullptr || name == PrototypeField)
+        return get(name);
+
+      cache.key = name;
+      cache.shape = shape;
+      cache.prototype = prototype;
+      cache.frozen = false;
+      cache.version = prototype_version;
+
+      if (auto slot = shape->lookup(name))
+      {
+        cache.kind = FieldCache::Kind::Own;
+        cache.slot = slot.value();
+        return fields.value(cache.slot);
+      }
+
+      // A receiver without prototype can't use a frozen chain
+      if (prototype == nullptr)
+      {
+        cache.kind = FieldCache::Kind::Missing;
+        return std::nullopt;
+      }
+
+      auto found = prototype->lookup_chain(name);
+      cache.frozen = found.frozen;
+      cache.version =
+        found.frozen ? frozen_prototype_version : prototype_version;
+      if (found.holder == nullptr)
+      {
+        cache.kind = FieldCache::Kind::Missing;
+        return std::nullopt;
+      }
+
+      cache.kind = FieldCache::Kind::Prototype;
+      cache.holder = found.holder;
+      cache.slot = found.slot;
+      return found.holder->fields.value(cache.slot);
+    }
+
     /// A destructive read of the value.
-    [[nodiscard]] DynObject* erase(std::string name)
+    [[nodiscard]] DynObject* erase(Atom name)
     {
-      auto result = fields.find(name);
-      if (result != fields.end())
+      if (auto value = fields.remove(name))
       {
-        auto value = result->second;
-        fields.erase(result);
-        return value;
+        if (is_used_as_prototype())
+          prototype_version++;
+        return value.value();
       }
 
       if (name == PrototypeField)
       {
         auto value = prototype;
         prototype = nullptr;
+        if (is_used_as_prototype())
+          prototype_version++;
         return value;
       }
 
       // Search the prototype chain.
-      // TODO make this iterative.
-      if (prototype != nullptr)
-        return prototype->erase(name);
+      for (auto obj = prototype; obj != nullptr; obj = obj->prototype)
+      {
+        if (auto value = obj->fields.remove(name))
+        {
+          prototype_version++;
+          if (obj->is_immutable())
+            frozen_prototype_version++;
+          return value.value();
+        }
+      }
 
       // No field or prototype chain found.
       return nullptr;
@@ -268,8 +582,24 @@ namespace rt::objects
       }
     }
 
-    [[nodiscard]] virtual DynObject* set(std::string name, DynObject* value)
+    [[nodiscard]] DynObject* set(Atom name, DynObject* value)
     {
+      if (get_kind() == Kind::Frame)
+      {
+        // Setting a stack key replaces the stack entry. This is used to
+        // invalidate references when a region is closed.
+        if (auto idx = stack_index(name))
+        {
+          auto stack = frame_stack();
+          assert(idx.value() < stack->size());
+          return std::exchange((*stack)[idx.value()], value);
+        }
+      }
+      else if (get_kind() == Kind::Cown)
+      {
+        return set_cown_value(name, value);
+      }
+
       assert_modifiable();
 
       if (name == PrototypeField)
@@ -277,8 +607,11 @@ namespace rt::objects
         return set_prototype(value);
       }
 
-      DynObject* old = fields[name];
-      fields[name] = value;
+      auto size = fields.size();
+      auto old = fields.set(name, value);
+      // A new key can shadow a key further up the prototype chain
+      if (is_used_as_prototype() && fields.size() != size)
+        prototype_version++;
       return old;
     }
 
@@ -288,6 +621,12 @@ namespace rt::objects
       assert_modifiable();
       DynObject* old = prototype;
       prototype = value;
+      if (value != nullptr)
+        value->mark_used_as_prototype();
+      // Other objects only see this change through this prototype. The
+      // lookups of this object check its prototype themselves.
+      if (is_used_as_prototype())
+        prototype_version++;
       return old;
     }
 
@@ -296,17 +635,99 @@ namespace rt::objects
       return prototype;
     }
 
+    /// Turns a former bridge object into an ordinary object, by removing the
+    /// region prototype. The caller has to remove the returned reference.
+    [[nodiscard]] DynObject* clear_region_prototype()
+    {
+      assert(get_kind() == Kind::Region);
+      region.set_tag(
+        (region.get_tag() & ~KindMask) | static_cast<uintptr_t>(Kind::Plain));
+      return set_prototype(nullptr);
+    }
+
     static size_t get_count()
     {
       return count;
     }
 
-    static std::set<DynObject*> get_objects()
+    /// All tracked objects, this is empty if the registry is disabled.
+    static const std::vector<DynObject*>& get_objects()
+    {
+      return registry;
+    }
+
+    /// Enables or disables the registry of all objects. Objects created while
+    /// it is disabled are only counted and never listed.
+    static void enable_registry(bool enabled)
     {
-      return all_objects;
+      use_registry = enabled;
+    }
+
+    static bool has_registry()
+    {
+      return use_registry;
     }
   };
 
+  inline ObjectList::Iterator::Iterator(DynObject* current_)
+  : current(current_), next(current_ ? current_->region_next : nullptr)
+  {}
+
+  inline ObjectList::Iterator& ObjectList::Iterator::operator++()
+  {
+    current = next;
+    next = current ? current->region_next : nullptr;
+    return *this;
+  }
+
+  inline void ObjectList::insert(DynObject* obj)
+  {
+    assert(!obj->region_prev && !obj->region_next && head != obj);
+    obj->region_prev = tail;
+    if (tail)
+      tail->region_next = obj;
+    else
+      head = obj;
+    tail = obj;
+    count++;
+  }
+
+  inline void ObjectList::erase(DynObject* obj)
+  {
+    // The object has to be in this list, otherwise the list is corrupted
+    assert(obj->region_prev || head == obj);
+    if (obj->region_prev)
+      obj->region_prev->region_next = obj->region_next;
+    else
+      head = obj->region_next;
+    if (obj->region_next)
+      obj->region_next->region_prev = obj->region_prev;
+    else
+      tail = obj->region_prev;
+    obj->region_prev = nullptr;
+    obj->region_next = nullptr;
+    count--;
+  }
+
+  inline void ObjectList::splice(ObjectList& other)
+  {
+    if (other.empty())
+      return;
+
+    if (tail)
+    {
+      tail->region_next = other.head;
+      other.head->region_prev = tail;
+    }
+    else
+    {
+      head = other.head;
+    }
+    tail = other.tail;
+    count += other.count;
+    other.clear();
+  }
+
   template<typename Pre, typename Post>
   inline void visit(Edge e, Pre pre, Post post)
   {
@@ -316,25 +737,38 @@ namespace rt::objects
     constexpr bool HasPost = !std::is_same_v<Post, NopDO>;
     constexpr uintptr_t POST{1};
 
-    std::vector<std::pair<utils::TaggedPointer<DynObject>, std::string>> stack;
+    // The targets are recorded, when the edge is pushed. This saves a second
+    // lookup and allows edges that are not stored as fields.
+    struct Item
+    {
+      utils::TaggedPointer<DynObject> obj;
+      Atom key;
+      DynObject* target;
+    };
+    std::vector<Item> stack;
 
     auto visit_object = [&](DynObject* obj) {
       if (obj == nullptr)
         return;
       if constexpr (HasPost)
-        stack.push_back({{obj, POST}, ""});
+        stack.push_back({{obj, POST}, {}, nullptr});
       // TODO This will need to depend on the type of object.
-      for (auto& [key, field] : obj->fields)
-        stack.push_back({obj, key});
+      for (auto [key, field] : obj->fields)
+        stack.push_back({obj, key, field});
+      if (auto obj_stack = obj->get_stack())
+      {
+        for (size_t i = 0; i < obj_stack->size(); i++)
+          stack.push_back({obj, stack_key(i), (*obj_stack)[i]});
+      }
       if (obj->prototype != nullptr)
-        stack.push_back({obj, PrototypeField});
+        stack.push_back({obj, PrototypeField, obj->prototype});
     };
 
     visit_object(e.target);
 
     while (!stack.empty())
     {
-      auto [obj, key] = stack.back();
+      auto [obj, key, next] = std::move(stack.back());
       auto obj_ptr = obj.get_ptr();
       stack.pop_back();
 
@@ -344,7 +778,6 @@ namespace rt::objects
         continue;
       }
 
-      DynObject* next = obj_ptr->get(key).value();
       if (pre({obj_ptr, key, next}))
       {
         visit_object(next);
@@ -355,7 +788,7 @@ namespace rt::objects
   template<typename Pre, typename Post>
   inline void visit(DynObject* start, Pre pre, Post post)
   {
-    visit(Edge{nullptr, "", start}, pre, post);
+    visit(Edge{nullptr, {}, start}, pre, post);
   }
 
   template<typename Pre, typename Post>
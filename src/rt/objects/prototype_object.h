@@ -13,7 +13,7 @@ namespace rt::objects
       std::string name_,
       objects::DynObject* prototype = nullptr,
       objects::Region* region = objects::immutable_region)
-    : objects::DynObject(prototype, region), name(name_)
+    : objects::DynObject(Kind::Prototype, prototype, region), name(name_)
     {}
 
     std::string get_name()
@@ -26,18 +26,19 @@ namespace rt::objects
   void implicit_freeze(DynObject* target)
   {
     // The `freeze()` call is the only required thing, the rest is just needed
-    // for helpful UI output.
-    std::set<DynObject*> pre_objects = immutable_region->objects;
-    target->freeze();
-    std::set<DynObject*> post_objects = immutable_region->objects;
-
+    // for helpful UI output. These are the objects that `freeze()` will visit.
     std::vector<DynObject*> effected_nodes;
-    std::set_difference(
-      post_objects.begin(),
-      post_objects.end(),
-      pre_objects.begin(),
-      pre_objects.end(),
-      std::back_inserter(effected_nodes));
+    std::set<DynObject*> seen;
+    visit(target, [&](Edge e) {
+      auto obj = e.target;
+      if (!obj || obj->is_immutable() || obj->is_cown())
+        return false;
+      if (!seen.insert(obj).second)
+        return false;
+      effected_nodes.push_back(obj);
+      return true;
+    });
+    target->freeze();
 
     std::stringstream ss;
     ss << "Internal: Implicit freeze effected " << effected_nodes.size()
@@ -52,18 +53,21 @@ namespace rt::objects
     size_t internal_references{0};
     size_t rc_of_added_objects{0};
 
-    visit({source, "", target}, [&](Edge e) {
+    visit({source, {}, target}, [&](Edge e) {
       auto obj = e.target;
       if (obj == nullptr || obj->is_immutable())
         return false;
 
       if (obj->region.get_ptr() == get_local_region())
       {
-        std::cout << "Adding object to region: " << obj->get_name()
-                  << " rc = " << obj->get_rc() << std::endl;
+        RT_LOG(
+          Region,
+          Trace,
+          "Adding object to region: " << obj->get_name()
+                                      << " rc = " << obj->get_rc());
         rc_of_added_objects += obj->get_rc();
         internal_references++;
-        obj->region = {r};
+        obj->region.set_ptr(r);
         get_local_region()->objects.erase(obj);
         r->objects.insert(obj);
         return true;
@@ -72,13 +76,15 @@ namespace rt::objects
       auto obj_region = get_region(obj);
       if (obj_region == r)
       {
-        std::cout << "Adding internal reference to object: " << obj->get_name()
-                  << std::endl;
+        RT_LOG(
+          Region,
+          Trace,
+          "Adding internal reference to object: " << obj->get_name());
         internal_references++;
         return false;
       }
 
-      if (obj->get_prototype() != objects::regionPrototypeObject())
+      if (obj->get_kind() != DynObject::Kind::Region)
       {
         if (Region::pragma_implicit_freezing)
         {
@@ -106,11 +112,14 @@ namespace rt::objects
 
     r->local_reference_count += rc_of_added_objects - internal_references;
 
-    std::cout << "Added " << rc_of_added_objects - internal_references
-              << " to LRC of region" << std::endl;
-    std::cout << "Region LRC: " << r->local_reference_count << std::endl;
-    std::cout << "Internal references found: " << internal_references
-              << std::endl;
+    RT_LOG(
+      Region,
+      Trace,
+      "Added " << rc_of_added_objects - internal_references
+               << " to LRC of region");
+    RT_LOG(Region, Trace, "Region LRC: " << r->local_reference_count);
+    RT_LOG(
+      Region, Trace, "Internal references found: " << internal_references);
   }
 
   void remove_region_reference(Region* src, Region* target)
@@ -137,8 +146,10 @@ namespace rt::objects
     if (src)
     {
       assert(target->parent == src);
-      std::cout << "Removing parent reference from region: " << src << " to "
-                << target << std::endl;
+      RT_LOG(
+        Region,
+        Trace,
+        "Removing parent reference from region: " << src << " to " << target);
       src->direct_subregions.erase(target->bridge);
       if (target->combined_lrc() != 0)
       {
@@ -177,8 +188,7 @@ namespace rt::objects
       return;
     }
 
-    auto is_region =
-      target->get_prototype() == objects::regionPrototypeObject();
+    auto is_region = target->get_kind() == DynObject::Kind::Region;
     if (is_region && target_region->parent == nullptr)
     {
       Region::set_parent(target_region, src_region);
@@ -195,14 +205,14 @@ namespace rt::objects
     {
       ui::error(
         "Cannot reference an object from another region",
-        {src_region->bridge, "", target});
+        {src_region->bridge, {}, target});
     }
     else
     {
       std::stringstream ss;
       ss << "Cannot reference region " << target << " from "
          << src_region->bridge << " since it already has a parent";
-      ui::error(ss.str(), {src_region->bridge, "", target});
+      ui::error(ss.str(), {src_region->bridge, {}, target});
     }
   }
 
@@ -221,13 +231,16 @@ namespace rt::objects
   void remove_reference(DynObject* src_initial, DynObject* old_dst_initial)
   {
     visit(
-      {src_initial, "", old_dst_initial},
+      {src_initial, {}, old_dst_initial},
       [&](Edge e) {
         if (e.target == nullptr)
           return false;
 
-        std::cout << "Remove reference from: " << e.src->get_name() << " to "
-                  << e.target->get_name() << std::endl;
+        RT_LOG(
+          Rc,
+          Trace,
+          "Remove reference from: " << e.src->get_name() << " to "
+                                    << e.target->get_name());
         bool result = e.target->change_rc(-1) == 0;
 
         remove_region_reference(get_region(e.src), get_region(e.target));
@@ -283,11 +296,11 @@ namespace rt::objects
 
     if (to_close_reg)
     {
-      std::cout << "Cleaning LRCs and closing " << to_close_reg << std::endl;
+      RT_LOG(Region, Trace, "Cleaning LRCs and closing " << to_close_reg);
     }
     else
     {
-      std::cout << "Cleaning LRCs" << std::endl;
+      RT_LOG(Region, Trace, "Cleaning LRCs");
     }
 
     for (auto r : dirty_regions)
@@ -342,8 +355,10 @@ namespace rt::objects
 
     for (auto r : dirty_regions)
     {
-      std::cout << "Corrected LRC of " << r << " to "
-                << r->local_reference_count << std::endl;
+      RT_LOG(
+        Region,
+        Trace,
+        "Corrected LRC of " << r << " to " << r->local_reference_count);
       r->is_lrc_dirty = false;
       if (r->combined_lrc() == 0)
       {
@@ -393,7 +408,7 @@ namespace rt::objects
       assert(target != nullptr);
       return get_region(src) == get_region(target);
     };
-    for (auto& [key, field] : obj->fields)
+    for (auto [key, field] : obj->fields)
     {
       if (field == nullptr)
         continue;
@@ -408,6 +423,24 @@ namespace rt::objects
       remove_reference(obj, old_value);
     }
 
+    if (auto stack = obj->get_stack())
+    {
+      for (auto& value : *stack)
+      {
+        if (value == nullptr)
+          continue;
+        if (same_region(obj, value))
+        {
+          value->change_rc(-1);
+          continue;
+        }
+
+        auto old_value = value;
+        value = nullptr;
+        remove_reference(obj, old_value);
+      }
+    }
+
     if ((obj->prototype != nullptr) && same_region(obj, obj->prototype))
     {
       // TODO When freeze is no longer immortal, this will need to be updated.
@@ -426,7 +459,7 @@ namespace rt::objects
     // So remove from region if in one.
     // This ensures we don't try to remove it from the set that is being
     // iterated.
-    obj->region = nullptr;
+    obj->region.set_ptr(nullptr);
     delete obj;
   }
 
@@ -436,7 +469,7 @@ namespace rt::objects
     RegionObject* obj = new RegionObject(r);
     r->bridge = obj;
     r->local_reference_count++;
-    std::cout << "Created region " << r << " with bridge " << obj << std::endl;
+    RT_LOG(Region, Trace, "Created region " << r << " with bridge " << obj);
     return obj;
   }
 
@@ -451,8 +484,10 @@ namespace rt::objects
       if (r != get_local_region() && r != cown_region)
       {
         to_collect.insert(r);
-        std::cout << "Collecting region: " << r << " with bridge: " << r->bridge
-                  << std::endl;
+        RT_LOG(
+          Region,
+          Trace,
+          "Collecting region: " << r << " with bridge: " << r->bridge);
       }
     }
   }
@@ -472,22 +507,22 @@ namespace rt::objects
   {
     for (auto obj : src->objects)
     {
-      auto r = get_region(obj);
-      std::cout << "Moving object: " << obj
-                << " with region bridge: " << r->bridge
-                << " to region with bridge: " << sink->bridge << std::endl;
-      obj->region = {sink};
-      sink->objects.insert(obj);
-      src->objects.erase(obj);
+      RT_LOG(
+        Region,
+        Trace,
+        "Moving object: " << obj << " with region bridge: " << src->bridge
+                          << " to region with bridge: " << sink->bridge);
+      obj->region.set_ptr(sink);
     }
+    sink->objects.splice(src->objects);
   }
 
   void merge_regions(DynObject* src, DynObject* sink)
   {
     assert(src != nullptr);
     assert(sink != nullptr);
-    assert(src->get_prototype() == objects::regionPrototypeObject());
-    assert(sink->get_prototype() == objects::regionPrototypeObject());
+    assert(src->get_kind() == DynObject::Kind::Region);
+    assert(sink->get_kind() == DynObject::Kind::Region);
 
     auto src_region = get_region(src);
     auto sink_region = get_region(sink);
@@ -502,6 +537,11 @@ namespace rt::objects
 
       return;
     }
+    // The source region is deleted by the merge, it can't be owned by a cown.
+    if (src_region->cown)
+    {
+      ui::error("Can't merge a region that is owned by a cown", src);
+    }
     // Design decision: Merging requires that the source region is a child of
     // the sink region.
     //
@@ -523,11 +563,13 @@ namespace rt::objects
       change_parent(obj, sink_region);
     }
 
-    sink_region->is_lrc_dirty =
-      sink_region->is_lrc_dirty || src_region->is_lrc_dirty;
+    if (src_region->is_lrc_dirty)
+    {
+      sink_region->mark_dirty();
+    }
     // Finalize dissasembly of region
     sink_region->direct_subregions.erase(src);
-    auto old_proto = src->set_prototype(nullptr);
+    auto old_proto = src->clear_region_prototype();
     remove_reference(src, old_proto);
     src_region->bridge = nullptr;
     // Adjust sbrc and lrc for `src_region` which was merged
@@ -538,16 +580,26 @@ namespace rt::objects
     sink_region->sub_region_reference_count +=
       src_region->sub_region_reference_count;
     sink_region->local_reference_count += src_region->local_reference_count;
+
+    // The source region is empty now
+    Region::dirty_regions.erase(src_region);
+    Region::to_collect.erase(src_region);
+    delete src_region;
   }
 
   void dissolve_region(DynObject* bridge)
   {
     assert(bridge != nullptr);
-    assert(bridge->get_prototype() == objects::regionPrototypeObject());
+    assert(bridge->get_kind() == DynObject::Kind::Region);
 
     auto r = get_region(bridge);
     assert(r != get_local_region());
 
+    // The region is deleted, the owning cown would keep a dangling pointer.
+    if (r->cown)
+    {
+      ui::error("Can't dissolve a region that is owned by a cown", bridge);
+    }
     if (r->parent != nullptr)
     {
       ui::error("Can't dissolve a region that is the child of another", bridge);
@@ -557,16 +609,20 @@ namespace rt::objects
     {
       auto obj_r = get_region(obj);
       obj_r->parent = nullptr;
-      r->direct_subregions.erase(obj);
       // Assumption: Exactly one outgoing reference from 'r' to 'obj_r'
       // Per: "References across regions must be externally unique references
       // to bridge objects or borrowed references"
       obj_r->local_reference_count++;
     }
+    r->direct_subregions.clear();
 
-    auto old_proto = bridge->set_prototype(nullptr);
+    auto old_proto = bridge->clear_region_prototype();
     remove_reference(bridge, old_proto);
     // Move all objects in the region
     move_objects(r, local_region);
+
+    Region::dirty_regions.erase(r);
+    Region::to_collect.erase(r);
+    delete r;
   }
 }
@@ -16,7 +16,9 @@ namespace rt::objects
   class RegionObject : public DynObject
   {
   public:
-    RegionObject(Region* region) : DynObject(regionPrototypeObject(), region) {}
+    RegionObject(Region* region)
+    : DynObject(Kind::Region, regionPrototypeObject(), region)
+    {}
 
     std::string get_name() override
     {
@@ -0,0 +1,356 @@
+#pragma once
+
+#include "../atom.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <optional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace rt::objects
+{
+  class DynObject;
+
+  /// A shape (or hidden class) describes the keys of an object and the slot
+  /// each key is stored in. Objects that received the same keys in the same
+  /// order share a shape. The field values are stored in a slot array in the
+  /// object itself.
+  ///
+  /// Shapes form a tree rooted in the empty shape. Adding a key follows, or
+  /// creates, a transition to a child shape. Shapes are never deallocated.
+  class Shape
+  {
+    /// The keys of this shape, in slot order.
+    std::vector<Atom> keys;
+    /// The shapes that are reached by adding a key to this shape.
+    std::unordered_map<Atom, Shape*> transitions;
+
+    Shape() = default;
+
+  public:
+    /// Objects with more keys than this switch to dictionary mode. The keys
+    /// of a shape are searched linearly, which is only fast for few keys.
+    static constexpr size_t MaxKeys{16};
+
+    // TODO: Not concurrency safe
+    static Shape* root()
+    {
+      static Shape* root = new Shape();
+      return root;
+    }
+
+    size_t size()
+    {
+      return keys.size();
+    }
+
+    Atom key(size_t slot)
+    {
+      return keys[slot];
+    }
+
+    std::optional<size_t> lookup(Atom key)
+    {
+      for (size_t i = 0; i < keys.size(); i++)
+      {
+        if (keys[i] == key)
+          return i;
+      }
+      return std::nullopt;
+    }
+
+    /// Returns the shape with `key` added as the last slot.
+    Shape* add(Atom key)
+    {
+      assert(!lookup(key));
+      auto search = transitions.find(key);
+      if (search != transitions.end())
+      {
+        return search->second;
+      }
+
+      auto child = new Shape();
+      child->keys = keys;
+      child->keys.push_back(key);
+      transitions[key] = child;
+      return child;
+    }
+  };
+
+  /// The field values of an object. The first values are stored inline, in
+  /// the object itself. Objects with more fields move all values to an array
+  /// on the heap.
+  class Slots
+  {
+    static constexpr uint32_t InlineCapacity{4};
+
+    uint32_t count{0};
+    uint32_t capacity{InlineCapacity};
+    union
+    {
+      DynObject* inline_values[InlineCapacity];
+      DynObject** heap_values;
+    };
+
+    bool is_inline()
+    {
+      return capacity == InlineCapacity;
+    }
+
+    DynObject** data()
+    {
+      return is_inline() ? inline_values : heap_values;
+    }
+
+    void grow()
+    {
+      auto new_capacity = capacity * 2;
+      auto values = new DynObject*[new_capacity];
+      std::copy(data(), data() + count, values);
+      if (!is_inline())
+      {
+        delete[] heap_values;
+      }
+      heap_values = values;
+      capacity = new_capacity;
+    }
+
+  public:
+    Slots() {}
+    Slots(const Slots&) = delete;
+    Slots& operator=(const Slots&) = delete;
+
+    ~Slots()
+    {
+      if (!is_inline())
+      {
+        delete[] heap_values;
+      }
+    }
+
+    size_t size()
+    {
+      return count;
+    }
+
+    DynObject*& operator[](size_t idx)
+    {
+      assert(idx < count);
+      return data()[idx];
+    }
+
+    void push_back(DynObject* value)
+    {
+      if (count == capacity)
+      {
+        grow();
+      }
+      data()[count++] = value;
+    }
+
+    void erase(size_t idx)
+    {
+      assert(idx < count);
+      auto values = data();
+      std::copy(values + idx + 1, values + count, values + idx);
+      count--;
+    }
+  };
+
+  /// The field storage of an object.
+  ///
+  /// The storage starts out with a shared `Shape`. Objects with many keys or
+  /// with removed keys switch to dictionary mode. In dictionary mode the
+  /// object owns its key table. In both modes the values live in `slots`
+  /// and keys keep the order they were added in.
+  class Fields
+  {
+    struct Dictionary
+    {
+      std::vector<Atom> keys;
+      std::unordered_map<Atom, size_t> index;
+    };
+
+    static constexpr uintptr_t DictionaryTag{1};
+
+    /// The shape or, tagged with `DictionaryTag`, the dictionary of this
+    /// storage. They share a word, which keeps the objects small.
+    uintptr_t layout{reinterpret_cast<uintptr_t>(Shape::root())};
+    Slots slots;
+
+    Shape* shape()
+    {
+      return layout & DictionaryTag ? nullptr :
+                                      reinterpret_cast<Shape*>(layout);
+    }
+
+    Dictionary* dictionary()
+    {
+      assert(layout & DictionaryTag);
+      return reinterpret_cast<Dictionary*>(layout & ~DictionaryTag);
+    }
+
+    void to_dictionary()
+    {
+      auto old_shape = shape();
+      assert(old_shape);
+      auto dict = new Dictionary();
+      for (size_t i = 0; i < old_shape->size(); i++)
+      {
+        dict->keys.push_back(old_shape->key(i));
+        dict->index[old_shape->key(i)] = i;
+      }
+      layout = reinterpret_cast<uintptr_t>(dict) | DictionaryTag;
+    }
+
+  public:
+    Fields() {}
+    Fields(const Fields&) = delete;
+    Fields& operator=(const Fields&) = delete;
+
+    ~Fields()
+    {
+      if (!shape())
+      {
+        delete dictionary();
+      }
+    }
+
+    /// The shape of this storage or `nullptr` in dictionary mode.
+    Shape* get_shape()
+    {
+      return shape();
+    }
+
+    size_t size()
+    {
+      return slots.size();
+    }
+
+    Atom key(size_t slot)
+    {
+      return shape() ? shape()->key(slot) : dictionary()->keys[slot];
+    }
+
+    DynObject*& value(size_t slot)
+    {
+      return slots[slot];
+    }
+
+    std::optional<size_t> lookup(Atom key)
+    {
+      if (shape())
+      {
+        return shape()->lookup(key);
+      }
+
+      auto search = dictionary()->index.find(key);
+      if (search != dictionary()->index.end())
+      {
+        return search->second;
+      }
+      return std::nullopt;
+    }
+
+    /// Returns a pointer to the value of `key` or `nullptr` if the key is
+    /// not present.
+    DynObject** find(Atom key)
+    {
+      auto slot = lookup(key);
+      return slot ? &slots[slot.value()] : nullptr;
+    }
+
+    /// Sets the value of `key` and returns the previous value.
+    [[nodiscard]] DynObject* set(Atom key, DynObject* value)
+    {
+      if (auto slot = lookup(key))
+      {
+        return std::exchange(slots[slot.value()], value);
+      }
+
+      if (shape() && shape()->size() >= Shape::MaxKeys)
+      {
+        to_dictionary();
+      }
+
+      if (shape())
+      {
+        layout = reinterpret_cast<uintptr_t>(shape()->add(key));
+      }
+      else
+      {
+        dictionary()->index[key] = dictionary()->keys.size();
+        dictionary()->keys.push_back(key);
+      }
+      slots.push_back(value);
+      return nullptr;
+    }
+
+    /// Removes `key` and returns its value, if it was present. Objects which
+    /// have keys removed switch to dictionary mode.
+    std::optional<DynObject*> remove(Atom key)
+    {
+      auto slot = lookup(key);
+      if (!slot)
+      {
+        return std::nullopt;
+      }
+
+      if (shape())
+      {
+        to_dictionary();
+      }
+
+      auto idx = slot.value();
+      auto value = slots[idx];
+      slots.erase(idx);
+      dictionary()->keys.erase(dictionary()->keys.begin() + idx);
+      dictionary()->index.erase(key);
+      for (size_t i = idx; i < dictionary()->keys.size(); i++)
+      {
+        dictionary()->index[dictionary()->keys[i]] = i;
+      }
+      return value;
+    }
+
+    /// Iterates over the `(key, value)` pairs, in the order the keys were
+    /// added. The value is a reference to the slot.
+    class Iterator
+    {
+      Fields* fields;
+      size_t slot;
+
+    public:
+      Iterator(Fields* fields_, size_t slot_) : fields(fields_), slot(slot_) {}
+
+      std::pair<Atom, DynObject*&> operator*()
+      {
+        return {fields->key(slot), fields->value(slot)};
+      }
+
+      Iterator& operator++()
+      {
+        slot++;
+        return *this;
+      }
+
+      bool operator!=(const Iterator& other) const
+      {
+        return slot != other.slot;
+      }
+    };
+
+    Iterator begin()
+    {
+      return {this, 0};
+    }
+
+    Iterator end()
+    {
+      return {this, slots.size()};
+    }
+  };
+} // namespace rt::objects
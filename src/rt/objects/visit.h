@@ -1,8 +1,7 @@
 #pragma once
 
 #include "../../utils/nop.h"
-
-#include <string>
+#include "../atom.h"
 
 namespace rt::objects
 {
@@ -12,7 +11,7 @@ namespace rt::objects
   struct Edge
   {
     DynObject* src;
-    std::string key;
+    Atom key;
     DynObject* target;
   };
 
@@ -15,10 +15,15 @@ namespace rt
   {
     auto builtin = new core::BuiltinFuncObject(func);
     core::globals()->insert(builtin);
-    core::global_names()->insert({name, builtin});
+    core::global_names()->insert({intern(name), builtin});
   }
 
   objects::DynObject* get_builtin(std::string name)
+  {
+    return get_builtin(intern(name));
+  }
+
+  objects::DynObject* get_builtin(Atom name)
   {
     auto globals = core::global_names();
 
@@ -45,6 +50,21 @@ namespace rt
     return new core::StringObject(value);
   }
 
+  objects::DynObject* get_str_constant(std::string_view value)
+  {
+    auto constants = core::string_constants();
+    auto search = constants->find(value);
+    if (search != constants->end())
+    {
+      return search->second;
+    }
+
+    auto obj = new core::StringObject(
+      std::string(value), objects::immutable_region);
+    constants->emplace(std::string(value), obj);
+    return obj;
+  }
+
   objects::DynObject* make_object()
   {
     return new objects::DynObject();
@@ -82,6 +102,11 @@ namespace rt
 
   std::optional<objects::DynObject*>
   get(objects::DynObject* obj, std::string key)
+  {
+    return get(obj, intern(key));
+  }
+
+  static void assert_accessible(objects::DynObject* obj)
   {
     if (obj->is_opaque())
     {
@@ -94,29 +119,62 @@ namespace rt
         ui::error("Cannot access data on an opaque type", obj);
       }
     }
+  }
+
+  std::optional<objects::DynObject*> get(objects::DynObject* obj, Atom key)
+  {
+    assert_accessible(obj);
     return obj->get(key);
   }
 
-  std::string get_key(objects::DynObject* key)
+  std::optional<objects::DynObject*>
+  get(objects::DynObject* obj, Atom key, FieldCache& cache)
+  {
+    assert_accessible(obj);
+    return obj->get(key, cache);
+  }
+
+  static core::StringObject* as_string_key(objects::DynObject* key)
   {
     // TODO Add some checking.  This is need to lookup the correct function in
     // the prototype chain.
-    if (key && key->get_prototype() != core::stringPrototypeObject())
+    if (key && key->get_kind() != objects::DynObject::Kind::String)
     {
       ui::error("Key must be a string.", key);
     }
-    core::StringObject* str_key = reinterpret_cast<core::StringObject*>(key);
-    return str_key->as_key();
+    return reinterpret_cast<core::StringObject*>(key);
+  }
+
+  std::string get_key(objects::DynObject* key)
+  {
+    return as_string_key(key)->as_key();
+  }
+
+  Atom get_key_atom(objects::DynObject* key)
+  {
+    return as_string_key(key)->as_atom();
   }
 
   std::optional<objects::DynObject*>
   get(objects::DynObject* obj, objects::DynObject* key)
   {
-    return get(obj, get_key(key));
+    return get(obj, get_key_atom(key));
+  }
+
+  std::optional<objects::DynObject*>
+  get(objects::DynObject* obj, objects::DynObject* key, FieldCache& cache)
+  {
+    return get(obj, get_key_atom(key), cache);
   }
 
   objects::DynObject*
   set(objects::DynObject* obj, std::string key, objects::DynObject* value)
+  {
+    return set(obj, intern(key), value);
+  }
+
+  objects::DynObject*
+  set(objects::DynObject* obj, Atom key, objects::DynObject* value)
   {
     if (!obj)
     {
@@ -128,7 +186,7 @@ namespace rt
   objects::DynObject* set(
     objects::DynObject* obj, objects::DynObject* key, objects::DynObject* value)
   {
-    return set(obj, get_key(key), value);
+    return set(obj, get_key_atom(key), value);
   }
 
   // TODO [[nodiscard]]
@@ -190,9 +248,14 @@ namespace rt
     objects::move_reference(src, dst, target);
   }
 
+  void enable_object_registry(bool enabled)
+  {
+    objects::DynObject::enable_registry(enabled);
+  }
+
   size_t pre_run(ui::UI* ui)
   {
-    std::cout << "Initilizing global objects" << std::endl;
+    RT_LOG(Interp, Info, "Initilizing global objects");
     core::globals();
     core::init_builtins(ui);
 
@@ -205,14 +268,14 @@ namespace rt
       }
     }
 
-    std::cout << "Running test..." << std::endl;
+    RT_LOG(Interp, Info, "Running test...");
     return objects::DynObject::get_count();
   }
 
   void post_run(size_t initial_count, ui::UI* ui)
   {
-    std::cout << "Test complete - checking for cycles in local region..."
-              << std::endl;
+    RT_LOG(
+      Interp, Info, "Test complete - checking for cycles in local region...");
     objects::Region::clean_lrcs();
     objects::Region::collect();
     auto globals = core::globals();
@@ -231,7 +294,7 @@ namespace rt
     }
 
     // Freeze global objects, to allow the termination of the local region
-    std::cout << "Freezing global objects" << std::endl;
+    RT_LOG(Interp, Info, "Freezing global objects");
     for (auto obj : *globals)
     {
       obj->freeze();
@@ -245,10 +308,12 @@ namespace rt
       std::cout << "Final count: " << objects::DynObject::get_count()
                 << std::endl;
 
-      std::vector<objects::DynObject*> roots;
-      for (auto obj : objects::DynObject::get_objects())
+      auto roots = objects::DynObject::get_objects();
+      if (!objects::DynObject::has_registry())
       {
-        roots.push_back(obj);
+        std::cout << "The object registry is disabled, the leaked objects "
+                     "can't be listed"
+                  << std::endl;
       }
       ui::MermaidUI::highlight_unreachable = true;
       ui->output(roots, "Memory leak detected!");
@@ -257,14 +322,23 @@ namespace rt
     }
     else
     {
-      std::cout << "No memory leaks detected!" << std::endl;
+      RT_LOG(Interp, Info, "No memory leaks detected!");
+    }
+
+    // Only the immutable and the cown region remain
+    if (objects::Region::get_count() != 2)
+    {
+      std::cout << "Region leak detected!" << std::endl;
+      std::cout << "Leaked regions: " << objects::Region::get_count() - 2
+                << std::endl;
+      std::exit(1);
     }
   }
 
   objects::DynObject* iter_next(objects::DynObject* iter)
   {
     assert(!iter->is_immutable());
-    if (iter && iter->get_prototype() != core::keyIterPrototypeObject())
+    if (iter && iter->get_kind() != objects::DynObject::Kind::Iter)
     {
       ui::error("Object is not an iterator.", iter);
     }
@@ -275,7 +349,7 @@ namespace rt
   std::optional<verona::interpreter::Bytecode*>
   try_get_bytecode(objects::DynObject* func)
   {
-    if (func && func->get_prototype() == core::bytecodeFuncPrototypeObject())
+    if (func && func->get_kind() == objects::DynObject::Kind::Func)
     {
       return reinterpret_cast<core::BytecodeFuncObject*>(func)->get_bytecode();
     }
@@ -284,7 +358,7 @@ namespace rt
 
   std::optional<BuiltinFuncPtr> try_get_builtin_func(objects::DynObject* func)
   {
-    if (func && func->get_prototype() == core::builtinFuncPrototypeObject())
+    if (func && func->get_kind() == objects::DynObject::Kind::Builtin)
     {
       return reinterpret_cast<core::BuiltinFuncObject*>(func)->get_func();
     }
@@ -293,11 +367,11 @@ namespace rt
 
   void merge_regions(objects::DynObject* src, objects::DynObject* sink)
   {
-    if (!src || src->get_prototype() != objects::regionPrototypeObject())
+    if (!src || src->get_kind() != objects::DynObject::Kind::Region)
     {
       ui::error("Source is not a region", src);
     }
-    if (!sink || sink->get_prototype() != objects::regionPrototypeObject())
+    if (!sink || sink->get_kind() != objects::DynObject::Kind::Region)
     {
       ui::error("Sink is not a region", sink);
     }
@@ -306,7 +380,7 @@ namespace rt
 
   void dissolve_region(objects::DynObject* bridge)
   {
-    if (!bridge || bridge->get_prototype() != objects::regionPrototypeObject())
+    if (!bridge || bridge->get_kind() != objects::DynObject::Kind::Region)
     {
       ui::error("Argument is not a region", bridge);
     }
@@ -315,7 +389,7 @@ namespace rt
 
   bool is_cown_released(objects::DynObject* cown)
   {
-    if (cown->get_prototype() != core::cownPrototypeObject())
+    if (cown->get_kind() != objects::DynObject::Kind::Cown)
     {
       ui::error("The given object is not a cown", cown);
     }
@@ -325,7 +399,7 @@ namespace rt
 
   void cown_update_state(objects::DynObject* cown)
   {
-    if (cown->get_prototype() != core::cownPrototypeObject())
+    if (cown->get_kind() != objects::DynObject::Kind::Cown)
     {
       ui::error("The given object is not a cown", cown);
     }
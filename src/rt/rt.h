@@ -1,12 +1,15 @@
 #pragma once
 
 #include "../lang/interpreter.h"
+#include "atom.h"
+#include "inline_cache.h"
 #include "objects/visit.h"
 #include "ui.h"
 
 #include <functional>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <vector>
 
 namespace rt
@@ -15,12 +18,17 @@ namespace rt
     verona::interpreter::FrameObj*, size_t)>;
   void add_builtin(std::string name, BuiltinFuncPtr func);
   objects::DynObject* get_builtin(std::string name);
+  objects::DynObject* get_builtin(Atom name);
   verona::interpreter::FrameObj*
   make_frame(verona::interpreter::FrameObj* parent);
 
   objects::DynObject* make_func(verona::interpreter::Bytecode* body);
   objects::DynObject* make_iter(objects::DynObject* iter_src);
   objects::DynObject* make_str(std::string str_value);
+  /// Returns the immutable string object of the string literal `value`.
+  /// The object is shared by all uses of the literal and is never
+  /// deallocated.
+  objects::DynObject* get_str_constant(std::string_view value);
   objects::DynObject* make_object();
   objects::DynObject* make_cown(objects::DynObject* region);
 
@@ -29,11 +37,20 @@ namespace rt
 
   std::optional<objects::DynObject*>
   get(objects::DynObject* src, std::string key);
+  std::optional<objects::DynObject*> get(objects::DynObject* src, Atom key);
+  /// Looks up the key like `get`, but uses and updates the given cache
+  std::optional<objects::DynObject*>
+  get(objects::DynObject* src, Atom key, FieldCache& cache);
+  std::optional<objects::DynObject*>
+  get(objects::DynObject* src, objects::DynObject* key, FieldCache& cache);
   std::optional<objects::DynObject*>
   get(objects::DynObject* src, objects::DynObject* key);
   std::string get_key(objects::DynObject* key);
+  Atom get_key_atom(objects::DynObject* key);
   objects::DynObject*
   set(objects::DynObject* dst, std::string key, objects::DynObject* value);
+  objects::DynObject*
+  set(objects::DynObject* dst, Atom key, objects::DynObject* value);
   objects::DynObject* set(
     objects::DynObject* dst,
     objects::DynObject* key,
@@ -53,6 +70,10 @@ namespace rt
     objects::DynObject* dst,
     objects::DynObject* target);
 
+  /// Enables the list of all objects, which is used to show leaked and
+  /// unreachable objects. Objects are always counted, to detect leaks.
+  void enable_object_registry(bool enabled);
+
   size_t pre_run(rt::ui::UI* ui);
   void post_run(size_t count, rt::ui::UI* ui);
 
@@ -4,7 +4,9 @@
 
 #include <cassert>
 #include <fstream>
+#include <functional>
 #include <iostream>
+#include <map>
 #include <set>
 #include <string>
 #include <vector>
@@ -179,9 +181,73 @@ namespace rt::ui
     std::vector<objects::DynObject*> local_root_objects();
   };
 
+  /// A UI that doesn't produce any snapshots. This is useful, if the output
+  /// is not needed, since every snapshot visits the entire heap.
+  ///
+  /// Errors are still reported on `stderr` with a textual summary of the
+  /// involved objects.
+  class HeadlessUI : public UI
+  {
+  public:
+    void set_output_file(std::string) override {}
+
+    void error(std::string msg) override;
+
+    void
+    error(std::string msg, std::vector<objects::DynObject*>& errors) override;
+
+    void error(std::string msg, std::vector<objects::Edge>& errors) override;
+
+    bool is_mermaid() override
+    {
+      return false;
+    }
+  };
+
+  using UIFactory = std::function<UI*()>;
+
+  /// The available UI backends by name. The backend is selected with
+  /// `select_ui`, before the global UI is first used.
+  inline std::map<std::string, UIFactory>* ui_backends()
+  {
+    static std::map<std::string, UIFactory>* backends =
+      new std::map<std::string, UIFactory>{
+        {"mermaid", []() -> UI* { return new MermaidUI(); }},
+        {"none", []() -> UI* { return new HeadlessUI(); }},
+      };
+    return backends;
+  }
+
+  inline UI*& global_ui_slot()
+  {
+    static UI* ui = nullptr;
+    return ui;
+  }
+
+  /// Creates the global UI from the backend with the given name. Returns
+  /// false, if no such backend exists.
+  inline bool select_ui(const std::string& name)
+  {
+    auto backends = ui_backends();
+    auto search = backends->find(name);
+    if (search == backends->end())
+    {
+      return false;
+    }
+
+    auto& ui = global_ui_slot();
+    assert(ui == nullptr && "the UI has to be selected before it's used");
+    ui = search->second();
+    return true;
+  }
+
   inline UI* globalUI()
   {
-    static UI* ui = new MermaidUI();
+    auto& ui = global_ui_slot();
+    if (ui == nullptr)
+    {
+      ui = new MermaidUI();
+    }
     return ui;
   }
 
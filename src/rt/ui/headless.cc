@@ -0,0 +1,39 @@
+#include "../objects/dyn_object.h"
+#include "../ui.h"
+
+#include <iostream>
+
+namespace rt::ui
+{
+  void HeadlessUI::error(std::string msg)
+  {
+    std::cerr << "Error: " << msg << std::endl;
+  }
+
+  void HeadlessUI::error(
+    std::string msg, std::vector<objects::DynObject*>& errors)
+  {
+    error(msg);
+    for (auto obj : errors)
+    {
+      if (obj == nullptr)
+      {
+        std::cerr << "| None" << std::endl;
+        continue;
+      }
+
+      std::cerr << "| " << obj << ": " << obj->get_name()
+                << " (rc=" << obj->get_rc() << ")" << std::endl;
+    }
+  }
+
+  void HeadlessUI::error(std::string msg, std::vector<objects::Edge>& errors)
+  {
+    error(msg);
+    for (auto& edge : errors)
+    {
+      std::cerr << "| " << edge.src << " --" << atom_name(edge.key) << "--> "
+                << edge.target << std::endl;
+    }
+  }
+} // namespace rt::ui
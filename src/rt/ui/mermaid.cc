@@ -152,12 +152,12 @@ namespace rt::ui
   private:
     std::pair<const char*, const char*> get_node_style(objects::DynObject* obj)
     {
-      if (obj->get_prototype() == core::cownPrototypeObject())
+      if (obj->get_kind() == objects::DynObject::Kind::Cown)
       {
         return {"[[", "]]"};
       }
 
-      if (obj->get_prototype() == objects::regionPrototypeObject())
+      if (obj->get_kind() == objects::DynObject::Kind::Region)
       {
         return {"[\\", "/]"};
       }
@@ -205,7 +205,7 @@ namespace rt::ui
         auto src_node = &nodes[src];
         out << *src_node;
         out << (is_borrow_edge(e) ? "-.->" : "-->");
-        out << " |" << escape(e.key) << "| ";
+        out << " |" << escape(rt::atom_name(e.key)) << "| ";
         edge_id = edge_counter;
         edge_counter += 1;
         src_node->edges[edge_id] = dst;
@@ -270,7 +270,7 @@ namespace rt::ui
           info->always_hide.contains(dst) ||
           (!reachable && info->unreachable_hide.contains(dst)) ||
           (!info->draw_funcs && dst &&
-           dst->get_prototype() == core::bytecodeFuncPrototypeObject()))
+           dst->get_kind() == objects::DynObject::Kind::Func))
         {
           return false;
         }
@@ -296,9 +296,9 @@ namespace rt::ui
       }
       // Output the unreachable parts of the graph
       reachable = false;
-      for (auto& root : objects::DynObject::all_objects)
+      for (auto& root : objects::DynObject::get_objects())
       {
-        objects::visit({nullptr, "", root}, explore);
+        objects::visit({nullptr, {}, root}, explore);
       }
     }
 
@@ -644,9 +644,8 @@ namespace rt::ui
 
   std::vector<objects::DynObject*> MermaidUI::local_root_objects()
   {
-    auto local_set = &objects::get_local_region()->objects;
     std::vector<objects::DynObject*> nodes_vec;
-    for (auto item : *local_set)
+    for (auto item : objects::get_local_region()->objects)
     {
       if (always_hide.contains(item) || unreachable_hide.contains(item))
       {
@@ -6,9 +6,13 @@
 
 namespace utils
 {
-  template<typename T>
+  /// A pointer, that stores a tag in its `TagBits` low bits. The pointee
+  /// has to be aligned to at least `1 << TagBits` bytes.
+  template<typename T, size_t TagBits = 2>
   class TaggedPointer
   {
+    static constexpr uintptr_t TagMask{(uintptr_t{1} << TagBits) - 1};
+
     uintptr_t ptr;
 
     constexpr TaggedPointer(uintptr_t ptr) : ptr(ptr) {}
@@ -21,12 +25,12 @@ namespace utils
     TaggedPointer(T* ptr, uintptr_t tag)
     : ptr(reinterpret_cast<uintptr_t>(ptr) | tag)
     {
-      assert(tag < 4);
+      assert(tag <= TagMask);
     }
 
     constexpr TaggedPointer(std::nullptr_t, std::uintptr_t tag) : ptr(tag)
     {
-      assert(tag < 4);
+      assert(tag <= TagMask);
     }
 
     bool operator==(TaggedPointer other) const
@@ -41,30 +45,31 @@ namespace utils
 
     void set_tag(uintptr_t tag)
     {
-      assert(tag < 4);
-      ptr = (ptr & ~0x3) | tag;
+      assert(tag <= TagMask);
+      ptr = (ptr & ~TagMask) | tag;
     }
 
     void set_ptr(T* new_ptr)
     {
-      ptr = (ptr & 0x3) | reinterpret_cast<uintptr_t>(new_ptr);
+      assert((reinterpret_cast<uintptr_t>(new_ptr) & TagMask) == 0);
+      ptr = (ptr & TagMask) | reinterpret_cast<uintptr_t>(new_ptr);
     }
 
     void add_tag(uintptr_t tag)
     {
-      assert(tag < 4);
+      assert(tag <= TagMask);
       ptr |= tag;
     }
 
     void remove_tag(uintptr_t tag)
     {
-      assert(tag < 4);
+      assert(tag <= TagMask);
       ptr &= ~tag;
     }
 
     T* get_ptr() const
     {
-      return reinterpret_cast<T*>(ptr & ~0x3);
+      return reinterpret_cast<T*>(ptr & ~TagMask);
     }
 
     operator T*() const
@@ -79,7 +84,7 @@ namespace utils
 
     uintptr_t get_tag() const
     {
-      return ptr & 0x3;
+      return ptr & TagMask;
     }
   };
 }
@@ -0,0 +1,70 @@
+# Checks that the bytecode cache is used by the second run of a program, that
+# editing the program invalidates it and that loading it respects the log
+# options.
+#
+# Usage: cmake -DFRANKENSCRIPT=<bin> -DPROGRAM=<file> -DWORK_DIR=<dir>
+#   -P bytecode_cache.cmake
+
+set(SOURCE ${WORK_DIR}/program.frank)
+set(CACHE_FILE ${WORK_DIR}/program.frankc)
+set(HIT "Loaded the bytecode cache")
+
+file(REMOVE_RECURSE ${WORK_DIR})
+file(MAKE_DIRECTORY ${WORK_DIR})
+configure_file(${PROGRAM} ${SOURCE} COPYONLY)
+
+# Runs the program and sets `HIT_${NAME}` to true, if the cache was used
+function(run NAME)
+  execute_process(
+    COMMAND ${FRANKENSCRIPT} build ${SOURCE} ${ARGN}
+    WORKING_DIRECTORY ${WORK_DIR}
+    RESULT_VARIABLE RESULT
+    OUTPUT_VARIABLE OUTPUT
+    ERROR_VARIABLE OUTPUT)
+  if (NOT RESULT EQUAL 0)
+    message(FATAL_ERROR "${NAME}: The program failed\n${OUTPUT}")
+  endif()
+  string(FIND "${OUTPUT}" "${HIT}" POS)
+  if (POS EQUAL -1)
+    set(HIT_${NAME} FALSE PARENT_SCOPE)
+  else()
+    set(HIT_${NAME} TRUE PARENT_SCOPE)
+  endif()
+  set(OUTPUT_${NAME} "${OUTPUT}" PARENT_SCOPE)
+endfunction()
+
+# The cache is only written with `--cache`
+run(no_cache)
+if (EXISTS ${CACHE_FILE})
+  message(FATAL_ERROR "The cache was written without --cache")
+endif()
+
+run(first --cache)
+if (HIT_first OR NOT EXISTS ${CACHE_FILE})
+  message(FATAL_ERROR "The first run should write the cache")
+endif()
+
+run(second --cache)
+if (NOT HIT_second)
+  message(FATAL_ERROR "The second run should load the cache")
+endif()
+
+# Editing the program invalidates the cache
+file(APPEND ${SOURCE} "\nedited = {}\n")
+run(edited --cache)
+if (HIT_edited)
+  message(FATAL_ERROR "The cache of the edited program was loaded")
+endif()
+
+run(edited_again --cache)
+if (NOT HIT_edited_again)
+  message(FATAL_ERROR "The cache of the edited program wasn't written")
+endif()
+
+# The log options also apply to the objects created while loading the cache.
+# This run loads the cache of the previous one.
+run(silent --cache --log-level none)
+string(FIND "${OUTPUT_silent}" "Allocate" POS)
+if (NOT POS EQUAL -1)
+  message(FATAL_ERROR "Loading the cache ignored --log-level none")
+endif()